@@ -24,6 +24,7 @@
 #include <linux/mm.h>
 #include <linux/mm_types.h>
 #include <linux/rbtree.h>
+#include <linux/rwsem.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/seq_file.h>
@@ -37,14 +38,19 @@
  * struct ion_device - the metadata of the ion device node
  * @dev:		the actual misc device
  * @buffers:	an rb tree of all the existing buffers
- * @lock:		lock protecting the buffers & heaps trees
+ * @buffer_lock:	lock protecting the buffers tree
+ * @lock:		lock protecting the client trees
+ * @heap_lock:		lock protecting the heaps tree, allocations only
+ *			need it for reading so they can proceed in parallel
  * @heaps:		list of all the heaps in the system
  * @user_clients:	list of all the clients created from userspace
  */
 struct ion_device {
 	struct miscdevice dev;
 	struct rb_root buffers;
+	struct mutex buffer_lock;
 	struct mutex lock;
+	struct rw_semaphore heap_lock;
 	struct rb_root heaps;
 	long (*custom_ioctl) (struct ion_client *client, unsigned int cmd,
 			      unsigned long arg);
@@ -59,13 +65,14 @@ struct ion_device {
  * @node:		node in the tree of all clients
  * @dev:		backpointer to ion device
  * @handles:		an rb tree of all the handles in this client
- * @lock:		lock protecting the tree of handles
+ * @buffers:		an rb tree of the same handles, indexed by buffer
+ * @lock:		lock protecting the trees of handles
  * @heap_mask:		mask of all supported heaps
  * @name:		used for debugging
  * @task:		used for debugging
  *
  * A client represents a list of buffers this client may access.
- * The mutex stored here is used to protect both handles tree
+ * The mutex stored here is used to protect both handles trees
  * as well as the handles themselves, and should be held while modifying either.
  */
 struct ion_client {
@@ -73,6 +80,7 @@ struct ion_client {
 	struct rb_node node;
 	struct ion_device *dev;
 	struct rb_root handles;
+	struct rb_root buffers;
 	struct mutex lock;
 	unsigned int heap_mask;
 	const char *name;
@@ -87,24 +95,27 @@ struct ion_client {
  * @client:		back pointer to the client the buffer resides in
  * @buffer:		pointer to the buffer
  * @node:		node in the client's handle rbtree
+ * @buffer_node:	node in the client's rbtree of handles by buffer
  * @kmap_cnt:		count of times this client has mapped to kernel
  * @dmap_cnt:		count of times this client has mapped for dma
  * @usermap_cnt:	count of times this client has mapped for userspace
  *
- * Modifications to node, map_cnt or mapping should be protected by the
- * lock in the client.  Other fields are never changed after initialization.
+ * Modifications to node, buffer_node, map_cnt or mapping should be protected
+ * by the lock in the client.  Other fields are never changed after
+ * initialization.
  */
 struct ion_handle {
 	struct kref ref;
 	struct ion_client *client;
 	struct ion_buffer *buffer;
 	struct rb_node node;
+	struct rb_node buffer_node;
 	unsigned int kmap_cnt;
 	unsigned int dmap_cnt;
 	unsigned int usermap_cnt;
 };
 
-/* this function should only be called while dev->lock is held */
+/* this function should only be called while dev->buffer_lock is held */
 static void ion_buffer_add(struct ion_device *dev,
 			   struct ion_buffer *buffer)
 {
@@ -130,7 +141,7 @@ static void ion_buffer_add(struct ion_device *dev,
 	rb_insert_color(&buffer->node, &dev->buffers);
 }
 
-/* this function should only be called while dev->lock is held */
+/* this function should only be called while dev->heap_lock is held */
 static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 				     struct ion_device *dev,
 				     unsigned long len,
@@ -155,7 +166,9 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	buffer->dev = dev;
 	buffer->size = len;
 	mutex_init(&buffer->lock);
+	mutex_lock(&dev->buffer_lock);
 	ion_buffer_add(dev, buffer);
+	mutex_unlock(&dev->buffer_lock);
 	return buffer;
 }
 
@@ -165,9 +178,9 @@ static void ion_buffer_destroy(struct kref *kref)
 	struct ion_device *dev = buffer->dev;
 
 	buffer->heap->ops->free(buffer);
-	mutex_lock(&dev->lock);
+	mutex_lock(&dev->buffer_lock);
 	rb_erase(&buffer->node, &dev->buffers);
-	mutex_unlock(&dev->lock);
+	mutex_unlock(&dev->buffer_lock);
 	kfree(buffer);
 }
 
@@ -191,6 +204,7 @@ static struct ion_handle *ion_handle_create(struct ion_client *client,
 		return ERR_PTR(-ENOMEM);
 	kref_init(&handle->ref);
 	rb_init_node(&handle->node);
+	rb_init_node(&handle->buffer_node);
 	handle->client = client;
 	ion_buffer_get(buffer);
 	handle->buffer = buffer;
@@ -208,6 +222,8 @@ static void ion_handle_destroy(struct kref *kref)
 	mutex_lock(&handle->client->lock);
 	if (!RB_EMPTY_NODE(&handle->node))
 		rb_erase(&handle->node, &handle->client->handles);
+	if (!RB_EMPTY_NODE(&handle->buffer_node))
+		rb_erase(&handle->buffer_node, &handle->client->buffers);
 	mutex_unlock(&handle->client->lock);
 	kfree(handle);
 }
@@ -227,15 +243,20 @@ static int ion_handle_put(struct ion_handle *handle)
 	return kref_put(&handle->ref, ion_handle_destroy);
 }
 
+/* this function should only be called while client->lock is held */
 static struct ion_handle *ion_handle_lookup(struct ion_client *client,
 					    struct ion_buffer *buffer)
 {
-	struct rb_node *n;
+	struct rb_node *n = client->buffers.rb_node;
 
-	for (n = rb_first(&client->handles); n; n = rb_next(n)) {
+	while (n) {
 		struct ion_handle *handle = rb_entry(n, struct ion_handle,
-						     node);
-		if (handle->buffer == buffer)
+						     buffer_node);
+		if (buffer < handle->buffer)
+			n = n->rb_left;
+		else if (buffer > handle->buffer)
+			n = n->rb_right;
+		else
 			return handle;
 	}
 	return NULL;
@@ -278,6 +299,24 @@ static void ion_handle_add(struct ion_client *client, struct ion_handle *handle)
 
 	rb_link_node(&handle->node, parent, p);
 	rb_insert_color(&handle->node, &client->handles);
+
+	p = &client->buffers.rb_node;
+	parent = NULL;
+
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct ion_handle, buffer_node);
+
+		if (handle->buffer < entry->buffer)
+			p = &(*p)->rb_left;
+		else if (handle->buffer > entry->buffer)
+			p = &(*p)->rb_right;
+		else
+			WARN(1, "%s: buffer already has a handle.", __func__);
+	}
+
+	rb_link_node(&handle->buffer_node, parent, p);
+	rb_insert_color(&handle->buffer_node, &client->buffers);
 }
 
 struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
@@ -294,7 +333,7 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 	 * request of the caller allocate from it.  Repeat until allocate has
 	 * succeeded or all heaps have been tried
 	 */
-	mutex_lock(&dev->lock);
+	down_read(&dev->heap_lock);
 	for (n = rb_first(&dev->heaps); n != NULL; n = rb_next(n)) {
 		struct ion_heap *heap = rb_entry(n, struct ion_heap, node);
 		/* if the client doesn't support this heap type */
@@ -307,7 +346,7 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 		if (!IS_ERR_OR_NULL(buffer))
 			break;
 	}
-	mutex_unlock(&dev->lock);
+	up_read(&dev->heap_lock);
 
 	if (IS_ERR_OR_NULL(buffer))
 		return ERR_PTR(PTR_ERR(buffer));
@@ -693,6 +732,7 @@ struct ion_client *ion_client_create(struct ion_device *dev,
 
 	client->dev = dev;
 	client->handles = RB_ROOT;
+	client->buffers = RB_ROOT;
 	mutex_init(&client->lock);
 	client->name = name;
 	client->heap_mask = heap_mask;
@@ -1130,7 +1170,7 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 	struct ion_heap *entry;
 
 	heap->dev = dev;
-	mutex_lock(&dev->lock);
+	down_write(&dev->heap_lock);
 	while (*p) {
 		parent = *p;
 		entry = rb_entry(parent, struct ion_heap, node);
@@ -1151,7 +1191,7 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 	debugfs_create_file(heap->name, 0664, dev->debug_root, heap,
 			    &debug_heap_fops);
 end:
-	mutex_unlock(&dev->lock);
+	up_write(&dev->heap_lock);
 }
 
 struct ion_device *ion_device_create(long (*custom_ioctl)
@@ -1182,7 +1222,9 @@ struct ion_device *ion_device_create(long (*custom_ioctl)
 
 	idev->custom_ioctl = custom_ioctl;
 	idev->buffers = RB_ROOT;
+	mutex_init(&idev->buffer_lock);
 	mutex_init(&idev->lock);
+	init_rwsem(&idev->heap_lock);
 	idev->heaps = RB_ROOT;
 	idev->user_clients = RB_ROOT;
 	idev->kernel_clients = RB_ROOT;
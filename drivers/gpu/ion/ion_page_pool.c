@@ -0,0 +1,126 @@
+/*
+ * drivers/gpu/ion/ion_page_pool.c
+ *
+ * Copyright (C) 2011 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/err.h>
+#include <linux/highmem.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include "ion_priv.h"
+
+static void ion_page_pool_clear(struct ion_page_pool *pool, struct page *page)
+{
+	int i;
+
+	for (i = 0; i < (1 << pool->order); i++)
+		clear_highpage(page + i);
+}
+
+static void ion_page_pool_add(struct ion_page_pool *pool, struct page *page)
+{
+	spin_lock(&pool->lock);
+	list_add(&page->lru, &pool->items);
+	pool->count++;
+	spin_unlock(&pool->lock);
+}
+
+static struct page *ion_page_pool_remove(struct ion_page_pool *pool)
+{
+	struct page *page = NULL;
+
+	spin_lock(&pool->lock);
+	if (pool->count) {
+		page = list_first_entry(&pool->items, struct page, lru);
+		list_del(&page->lru);
+		pool->count--;
+	}
+	spin_unlock(&pool->lock);
+	return page;
+}
+
+struct page *ion_page_pool_alloc(struct ion_page_pool *pool)
+{
+	struct page *page;
+
+	page = ion_page_pool_remove(pool);
+	if (page)
+		return page;
+
+	/* the pool is empty, fall back to the page allocator */
+	return alloc_pages(pool->gfp_mask, pool->order);
+}
+
+void ion_page_pool_free(struct ion_page_pool *pool, struct page *page)
+{
+	/* pages in the pool are always zeroed, do it here, off the alloc path */
+	ion_page_pool_clear(pool, page);
+	ion_page_pool_add(pool, page);
+}
+
+int ion_page_pool_fill(struct ion_page_pool *pool, int nr)
+{
+	int filled = 0;
+
+	while (pool->count < nr) {
+		struct page *page = alloc_pages(pool->gfp_mask, pool->order);
+
+		if (!page)
+			break;
+		ion_page_pool_add(pool, page);
+		filled++;
+	}
+	return filled;
+}
+
+int ion_page_pool_shrink(struct ion_page_pool *pool, int nr_to_scan)
+{
+	int freed = 0;
+
+	if (nr_to_scan == 0)
+		return pool->count << pool->order;
+
+	while (freed < nr_to_scan) {
+		struct page *page = ion_page_pool_remove(pool);
+
+		if (!page)
+			break;
+		__free_pages(page, pool->order);
+		freed += 1 << pool->order;
+	}
+	return freed;
+}
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order)
+{
+	struct ion_page_pool *pool;
+
+	pool = kmalloc(sizeof(struct ion_page_pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+	pool->count = 0;
+	INIT_LIST_HEAD(&pool->items);
+	spin_lock_init(&pool->lock);
+	pool->gfp_mask = gfp_mask | __GFP_ZERO;
+	pool->order = order;
+	return pool;
+}
+
+void ion_page_pool_destroy(struct ion_page_pool *pool)
+{
+	ion_page_pool_shrink(pool, INT_MAX);
+	kfree(pool);
+}
@@ -21,6 +21,7 @@
 #include <linux/mm_types.h>
 #include <linux/mutex.h>
 #include <linux/rbtree.h>
+#include <linux/spinlock.h>
 #include <linux/ion.h>
 
 struct ion_mapping;
@@ -181,4 +182,43 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
  */
 #define ION_CARVEOUT_ALLOCATE_FAIL -1
 
+/**
+ * struct ion_page_pool - pagepool struct
+ * @count:		number of chunks in the pool
+ * @items:		list of chunks, linked through page->lru
+ * @lock:		lock protecting this struct and the list
+ * @gfp_mask:		gfp_mask to use when allocating from the page allocator
+ * @order:		order of the chunks in the pool
+ *
+ * Allows a heap to keep zeroed chunks of a given order around, so that
+ * allocations do not have to go to the page allocator every time.  Chunks
+ * are zeroed when they are returned to the pool.  The pool never shrinks
+ * on its own, the owner should call ion_page_pool_shrink from a shrinker.
+ */
+struct ion_page_pool {
+	int count;
+	struct list_head items;
+	spinlock_t lock;
+	gfp_t gfp_mask;
+	unsigned int order;
+};
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order);
+void ion_page_pool_destroy(struct ion_page_pool *);
+struct page *ion_page_pool_alloc(struct ion_page_pool *);
+void ion_page_pool_free(struct ion_page_pool *, struct page *);
+/**
+ * ion_page_pool_fill - top the pool up to @nr chunks
+ *
+ * returns the number of chunks added
+ */
+int ion_page_pool_fill(struct ion_page_pool *pool, int nr);
+/**
+ * ion_page_pool_shrink - free up to @nr_to_scan pages from the pool
+ *
+ * returns the number of pages freed, or the number of pages in the pool
+ * if @nr_to_scan is 0
+ */
+int ion_page_pool_shrink(struct ion_page_pool *pool, int nr_to_scan);
+
 #endif /* _ION_PRIV_H */
@@ -15,80 +15,300 @@
  */
 
 #include <linux/err.h>
+#include <linux/highmem.h>
 #include <linux/ion.h>
+#include <linux/jiffies.h>
 #include <linux/mm.h>
 #include <linux/scatterlist.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include "ion_priv.h"
 
+/*
+ * Buffers are built from the largest chunks available, trying these orders
+ * from first to last.  High-order chunks keep the scatterlists short and
+ * are kinder to the TLB and IOMMU of whoever maps them.
+ */
+static const unsigned int orders[] = {4, 2, 0};
+#define NUM_ORDERS ARRAY_SIZE(orders)
+
+/* high-order pools are refilled in the background up to this many bytes */
+#define ION_SYSTEM_HEAP_POOL_FILL	(256 * 1024)
+
+static int order_to_index(unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		if (order == orders[i])
+			return i;
+	BUG();
+	return -1;
+}
+
+static int order_to_fill(unsigned int order)
+{
+	if (!order)
+		return 0;
+	return ION_SYSTEM_HEAP_POOL_FILL >> (PAGE_SHIFT + order);
+}
+
+/**
+ * struct ion_system_heap - the system heap
+ * @heap:		the ion heap
+ * @pools:		one pool of free chunks per entry in orders[]
+ * @shrinker:		drains the pools under memory pressure
+ * @fill_work:		refills the high-order pools after allocations
+ * @last_shrink:	jiffies of the last call to the shrinker, we hold off
+ *			refilling for a while after it
+ */
+struct ion_system_heap {
+	struct ion_heap heap;
+	struct ion_page_pool *pools[NUM_ORDERS];
+	struct shrinker shrinker;
+	struct work_struct fill_work;
+	unsigned long last_shrink;
+};
+
+/**
+ * struct ion_system_buffer_info - the chunks backing a system heap buffer
+ * @sglist:		one entry per chunk, the chunk order is derived
+ *			from its length
+ * @nents:		number of entries in @sglist
+ */
+struct ion_system_buffer_info {
+	struct scatterlist *sglist;
+	int nents;
+};
+
+static struct page *alloc_largest_available(struct ion_system_heap *heap,
+					    unsigned long size,
+					    unsigned int max_order)
+{
+	struct page *page;
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (size < (PAGE_SIZE << orders[i]))
+			continue;
+		if (max_order < orders[i])
+			continue;
+
+		page = ion_page_pool_alloc(heap->pools[i]);
+		if (!page)
+			continue;
+		/* stash the order until the scatterlist is built */
+		set_page_private(page, orders[i]);
+		return page;
+	}
+	return NULL;
+}
+
+static void ion_system_heap_kick_fill(struct ion_system_heap *heap)
+{
+	int i;
+
+	if (time_before(jiffies, heap->last_shrink + HZ))
+		return;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (heap->pools[i]->count < order_to_fill(orders[i])) {
+			schedule_work(&heap->fill_work);
+			return;
+		}
+	}
+}
+
+static void ion_system_heap_fill(struct work_struct *work)
+{
+	struct ion_system_heap *heap = container_of(work,
+						    struct ion_system_heap,
+						    fill_work);
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		ion_page_pool_fill(heap->pools[i], order_to_fill(orders[i]));
+}
+
 static int ion_system_heap_allocate(struct ion_heap *heap,
 				     struct ion_buffer *buffer,
 				     unsigned long size, unsigned long align,
 				     unsigned long flags)
 {
-	buffer->priv_virt = vmalloc_user(size);
-	if (!buffer->priv_virt)
-		return -ENOMEM;
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	struct ion_system_buffer_info *info;
+	struct scatterlist *sg;
+	struct list_head pages;
+	struct page *page, *tmp_page;
+	unsigned long size_remaining = PAGE_ALIGN(size);
+	unsigned int max_order = orders[0];
+	int nents = 0;
+
+	INIT_LIST_HEAD(&pages);
+	while (size_remaining > 0) {
+		page = alloc_largest_available(sys_heap, size_remaining,
+					       max_order);
+		if (!page)
+			goto err;
+		list_add_tail(&page->lru, &pages);
+		size_remaining -= PAGE_SIZE << page_private(page);
+		max_order = page_private(page);
+		nents++;
+	}
+
+	info = kmalloc(sizeof(struct ion_system_buffer_info), GFP_KERNEL);
+	if (!info)
+		goto err;
+
+	if (nents * sizeof(struct scatterlist) <= PAGE_SIZE)
+		info->sglist = kmalloc(nents * sizeof(struct scatterlist),
+				       GFP_KERNEL);
+	else
+		info->sglist = vmalloc(nents * sizeof(struct scatterlist));
+	if (!info->sglist)
+		goto err1;
+
+	sg_init_table(info->sglist, nents);
+	info->nents = nents;
+	sg = info->sglist;
+	list_for_each_entry_safe(page, tmp_page, &pages, lru) {
+		sg_set_page(sg, page, PAGE_SIZE << page_private(page), 0);
+		set_page_private(page, 0);
+		list_del(&page->lru);
+		sg = sg_next(sg);
+	}
+
+	buffer->priv_virt = info;
+	ion_system_heap_kick_fill(sys_heap);
 	return 0;
+
+err1:
+	kfree(info);
+err:
+	list_for_each_entry_safe(page, tmp_page, &pages, lru) {
+		unsigned int order = page_private(page);
+
+		set_page_private(page, 0);
+		list_del(&page->lru);
+		ion_page_pool_free(sys_heap->pools[order_to_index(order)],
+				   page);
+	}
+	return -ENOMEM;
 }
 
 void ion_system_heap_free(struct ion_buffer *buffer)
 {
-	vfree(buffer->priv_virt);
+	struct ion_system_heap *sys_heap = container_of(buffer->heap,
+							struct ion_system_heap,
+							heap);
+	struct ion_system_buffer_info *info = buffer->priv_virt;
+	struct scatterlist *sg;
+	int i;
+
+	/* a client that leaked a kernel mapping, drop it with the pages */
+	if (buffer->kmap_cnt)
+		vunmap(buffer->vaddr);
+
+	for_each_sg(info->sglist, sg, info->nents, i) {
+		unsigned int order = get_order(sg->length);
+
+		ion_page_pool_free(sys_heap->pools[order_to_index(order)],
+				   sg_page(sg));
+	}
+
+	if (is_vmalloc_addr(info->sglist))
+		vfree(info->sglist);
+	else
+		kfree(info->sglist);
+	kfree(info);
 }
 
 struct scatterlist *ion_system_heap_map_dma(struct ion_heap *heap,
 					    struct ion_buffer *buffer)
 {
-	struct scatterlist *sglist;
-	struct page *page;
-	int i;
-	int npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
-	void *vaddr = buffer->priv_virt;
+	struct ion_system_buffer_info *info = buffer->priv_virt;
 
-	sglist = vmalloc(npages * sizeof(struct scatterlist));
-	if (!sglist)
-		return ERR_PTR(-ENOMEM);
-	memset(sglist, 0, npages * sizeof(struct scatterlist));
-	sg_init_table(sglist, npages);
-	for (i = 0; i < npages; i++) {
-		page = vmalloc_to_page(vaddr);
-		if (!page)
-			goto end;
-		sg_set_page(&sglist[i], page, PAGE_SIZE, 0);
-		vaddr += PAGE_SIZE;
-	}
 	/* XXX do cache maintenance for dma? */
-	return sglist;
-end:
-	vfree(sglist);
-	return NULL;
+	return info->sglist;
 }
 
 void ion_system_heap_unmap_dma(struct ion_heap *heap,
 			       struct ion_buffer *buffer)
 {
 	/* XXX undo cache maintenance for dma? */
-	if (buffer->sglist)
-		vfree(buffer->sglist);
 }
 
 void *ion_system_heap_map_kernel(struct ion_heap *heap,
 				 struct ion_buffer *buffer)
 {
-	return buffer->priv_virt;
+	struct ion_system_buffer_info *info = buffer->priv_virt;
+	int npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
+	struct page **pages;
+	struct scatterlist *sg;
+	void *vaddr;
+	int i, j, n = 0;
+
+	pages = vmalloc(sizeof(struct page *) * npages);
+	if (!pages)
+		return ERR_PTR(-ENOMEM);
+
+	for_each_sg(info->sglist, sg, info->nents, i) {
+		struct page *page = sg_page(sg);
+
+		for (j = 0; j < sg->length / PAGE_SIZE; j++)
+			pages[n++] = page++;
+	}
+
+	vaddr = vmap(pages, npages, VM_MAP, PAGE_KERNEL);
+	vfree(pages);
+
+	if (!vaddr)
+		return ERR_PTR(-ENOMEM);
+	return vaddr;
 }
 
 void ion_system_heap_unmap_kernel(struct ion_heap *heap,
 				  struct ion_buffer *buffer)
 {
+	vunmap(buffer->vaddr);
 }
 
 int ion_system_heap_map_user(struct ion_heap *heap, struct ion_buffer *buffer,
 			     struct vm_area_struct *vma)
 {
-	return remap_vmalloc_range(vma, buffer->priv_virt, vma->vm_pgoff);
+	struct ion_system_buffer_info *info = buffer->priv_virt;
+	unsigned long addr = vma->vm_start;
+	unsigned long offset = vma->vm_pgoff * PAGE_SIZE;
+	struct scatterlist *sg;
+	int i;
+	int ret;
+
+	for_each_sg(info->sglist, sg, info->nents, i) {
+		struct page *page = sg_page(sg);
+		unsigned long remainder = vma->vm_end - addr;
+		unsigned long len = sg->length;
+
+		if (offset >= sg->length) {
+			offset -= sg->length;
+			continue;
+		} else if (offset) {
+			page += offset / PAGE_SIZE;
+			len = sg->length - offset;
+			offset = 0;
+		}
+		len = min(len, remainder);
+		ret = remap_pfn_range(vma, addr, page_to_pfn(page), len,
+				      vma->vm_page_prot);
+		if (ret)
+			return ret;
+		addr += len;
+		if (addr >= vma->vm_end)
+			return 0;
+	}
+	return 0;
 }
 
 static struct ion_heap_ops vmalloc_ops = {
@@ -101,21 +321,90 @@ static struct ion_heap_ops vmalloc_ops = {
 	.map_user = ion_system_heap_map_user,
 };
 
+static int ion_system_heap_shrink(struct shrinker *shrinker,
+				  struct shrink_control *sc)
+{
+	struct ion_system_heap *heap = container_of(shrinker,
+						    struct ion_system_heap,
+						    shrinker);
+	int nr_to_scan = sc->nr_to_scan;
+	int nr_total = 0;
+	int i;
+
+	if (nr_to_scan)
+		heap->last_shrink = jiffies;
+
+	/* give up the small chunks first, the big ones are harder to get */
+	for (i = NUM_ORDERS - 1; i >= 0; i--) {
+		int nr_freed;
+
+		if (!nr_to_scan) {
+			nr_total += ion_page_pool_shrink(heap->pools[i], 0);
+			continue;
+		}
+		nr_freed = ion_page_pool_shrink(heap->pools[i], nr_to_scan);
+		nr_to_scan -= nr_freed;
+		if (nr_to_scan <= 0)
+			break;
+	}
+
+	if (sc->nr_to_scan)
+		for (i = 0; i < NUM_ORDERS; i++)
+			nr_total += ion_page_pool_shrink(heap->pools[i], 0);
+
+	return nr_total;
+}
+
 struct ion_heap *ion_system_heap_create(struct ion_platform_heap *unused)
 {
-	struct ion_heap *heap;
+	struct ion_system_heap *heap;
+	int i;
 
-	heap = kzalloc(sizeof(struct ion_heap), GFP_KERNEL);
+	heap = kzalloc(sizeof(struct ion_system_heap), GFP_KERNEL);
 	if (!heap)
 		return ERR_PTR(-ENOMEM);
-	heap->ops = &vmalloc_ops;
-	heap->type = ION_HEAP_TYPE_SYSTEM;
-	return heap;
+	heap->heap.ops = &vmalloc_ops;
+	heap->heap.type = ION_HEAP_TYPE_SYSTEM;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		gfp_t gfp_flags = GFP_HIGHUSER;
+
+		/* high-order chunks are a bonus, don't work hard for them */
+		if (orders[i])
+			gfp_flags |= __GFP_NOWARN | __GFP_NORETRY |
+				     __GFP_NO_KSWAPD;
+		heap->pools[i] = ion_page_pool_create(gfp_flags, orders[i]);
+		if (!heap->pools[i])
+			goto err;
+	}
+
+	INIT_WORK(&heap->fill_work, ion_system_heap_fill);
+	heap->last_shrink = jiffies - HZ;
+	heap->shrinker.shrink = ion_system_heap_shrink;
+	heap->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&heap->shrinker);
+	schedule_work(&heap->fill_work);
+	return &heap->heap;
+
+err:
+	while (i--)
+		ion_page_pool_destroy(heap->pools[i]);
+	kfree(heap);
+	return ERR_PTR(-ENOMEM);
 }
 
 void ion_system_heap_destroy(struct ion_heap *heap)
 {
-	kfree(heap);
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	int i;
+
+	unregister_shrinker(&sys_heap->shrinker);
+	cancel_work_sync(&sys_heap->fill_work);
+	for (i = 0; i < NUM_ORDERS; i++)
+		ion_page_pool_destroy(sys_heap->pools[i]);
+	kfree(sys_heap);
 }
 
 static int ion_system_contig_heap_allocate(struct ion_heap *heap,
@@ -157,6 +446,24 @@ struct scatterlist *ion_system_contig_heap_map_dma(struct ion_heap *heap,
 	return sglist;
 }
 
+void ion_system_contig_heap_unmap_dma(struct ion_heap *heap,
+				      struct ion_buffer *buffer)
+{
+	if (buffer->sglist)
+		vfree(buffer->sglist);
+}
+
+void *ion_system_contig_heap_map_kernel(struct ion_heap *heap,
+					struct ion_buffer *buffer)
+{
+	return buffer->priv_virt;
+}
+
+void ion_system_contig_heap_unmap_kernel(struct ion_heap *heap,
+					 struct ion_buffer *buffer)
+{
+}
+
 int ion_system_contig_heap_map_user(struct ion_heap *heap,
 				    struct ion_buffer *buffer,
 				    struct vm_area_struct *vma)
@@ -173,9 +480,9 @@ static struct ion_heap_ops kmalloc_ops = {
 	.free = ion_system_contig_heap_free,
 	.phys = ion_system_contig_heap_phys,
 	.map_dma = ion_system_contig_heap_map_dma,
-	.unmap_dma = ion_system_heap_unmap_dma,
-	.map_kernel = ion_system_heap_map_kernel,
-	.unmap_kernel = ion_system_heap_unmap_kernel,
+	.unmap_dma = ion_system_contig_heap_unmap_dma,
+	.map_kernel = ion_system_contig_heap_map_kernel,
+	.unmap_kernel = ion_system_contig_heap_unmap_kernel,
 	.map_user = ion_system_contig_heap_map_user,
 };
 
@@ -10,20 +10,166 @@
 #include <linux/init.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/suspend.h>
+#include <linux/reboot.h>
+#include <linux/notifier.h>
 
-#define FSYNCCONTROL_VERSION 1
+#define FSYNCCONTROL_VERSION 2
 
-static bool fsync_enabled = true;
+#define FSYNC_MODE_OFF 0
+#define FSYNC_MODE_ON 1
+#define FSYNC_MODE_DEFERRED 2
+
+#define FSYNC_DEFAULT_DELAY_MS 1000
+#define FSYNC_MAX_DELAY_MS 10000
+
+/*
+ * Superblocks with a deferred sync outstanding.  They are remembered by
+ * s_dev rather than by pointer so that nothing is pinned and an unmount
+ * in the meantime simply makes the entry match nothing.  If more
+ * filesystems than fit here are waiting, all of them are synced.
+ */
+#define FSYNC_DEFERRED_MAX 8
+
+struct fsync_deferred
+{
+    dev_t devs[FSYNC_DEFERRED_MAX];
+    unsigned int count;
+    bool all;
+};
+
+static unsigned int fsync_mode = FSYNC_MODE_ON;
+
+static unsigned int fsync_delay_ms = FSYNC_DEFAULT_DELAY_MS;
+
+static struct fsync_deferred deferred;
+
+static DEFINE_SPINLOCK(deferred_lock);
+
+static void fsynccontrol_deferred_work(struct work_struct * work);
+
+static DECLARE_DELAYED_WORK(deferred_work, fsynccontrol_deferred_work);
 
 bool fsynccontrol_fsync_enabled()
 {
-    return fsync_enabled;
+    return fsync_mode == FSYNC_MODE_ON;
 }
 EXPORT_SYMBOL(fsynccontrol_fsync_enabled);
 
+/*
+ * Called from the fsync paths instead of syncing when fsync is not
+ * enabled.  In deferred mode the superblock is queued and the flush is
+ * scheduled, so every fsync on it within the window is covered by one
+ * sync_filesystem() (one journal commit) when the window closes.
+ */
+void fsynccontrol_defer_sync(struct super_block * sb)
+{
+    unsigned int i;
+
+    if (fsync_mode != FSYNC_MODE_DEFERRED)
+	return;
+
+    spin_lock(&deferred_lock);
+
+    for (i = 0; i < deferred.count; i++)
+	{
+	    if (deferred.devs[i] == sb->s_dev)
+		goto queued;
+	}
+
+    if (deferred.count < FSYNC_DEFERRED_MAX)
+	deferred.devs[deferred.count++] = sb->s_dev;
+    else
+	deferred.all = true;
+
+ queued:
+    spin_unlock(&deferred_lock);
+
+    /* a no-op if already pending, so the first deferral bounds the window */
+    schedule_delayed_work(&deferred_work, msecs_to_jiffies(fsync_delay_ms));
+}
+EXPORT_SYMBOL(fsynccontrol_defer_sync);
+
+static void fsynccontrol_sync_sb(struct super_block * sb, void * arg)
+{
+    struct fsync_deferred * set = arg;
+    unsigned int i;
+
+    if (!set->all)
+	{
+	    for (i = 0; i < set->count; i++)
+		{
+		    if (set->devs[i] == sb->s_dev)
+			break;
+		}
+
+	    if (i == set->count)
+		return;
+	}
+
+    /* iterate_supers() holds s_umount for us */
+    sync_filesystem(sb);
+}
+
+static void fsynccontrol_flush(void)
+{
+    struct fsync_deferred set;
+
+    spin_lock(&deferred_lock);
+    set = deferred;
+    deferred.count = 0;
+    deferred.all = false;
+    spin_unlock(&deferred_lock);
+
+    if (!set.count && !set.all)
+	return;
+
+    iterate_supers(fsynccontrol_sync_sb, &set);
+}
+
+static void fsynccontrol_deferred_work(struct work_struct * work)
+{
+    fsynccontrol_flush();
+}
+
+/* Write out everything still deferred, synchronously. */
+static void fsynccontrol_flush_now(void)
+{
+    cancel_delayed_work_sync(&deferred_work);
+    fsynccontrol_flush();
+}
+
+static int fsynccontrol_pm_notify(struct notifier_block * nb, unsigned long event, void * unused)
+{
+    if (event == PM_SUSPEND_PREPARE || event == PM_HIBERNATION_PREPARE)
+	fsynccontrol_flush_now();
+
+    return NOTIFY_DONE;
+}
+
+static struct notifier_block fsynccontrol_pm_nb = 
+    {
+	.notifier_call = fsynccontrol_pm_notify,
+    };
+
+static int fsynccontrol_reboot_notify(struct notifier_block * nb, unsigned long event, void * unused)
+{
+    fsynccontrol_flush_now();
+
+    return NOTIFY_DONE;
+}
+
+static struct notifier_block fsynccontrol_reboot_nb = 
+    {
+	.notifier_call = fsynccontrol_reboot_notify,
+    };
+
 static ssize_t fsynccontrol_status_read(struct device * dev, struct device_attribute * attr, char * buf)
 {
-    return sprintf(buf, "%u\n", (fsync_enabled ? 1 : 0));
+    return sprintf(buf, "%u\n", fsync_mode);
 }
 
 static ssize_t fsynccontrol_status_write(struct device * dev, struct device_attribute * attr, const char * buf, size_t size)
@@ -32,18 +178,57 @@ static ssize_t fsynccontrol_status_write(struct device * dev, struct device_attr
 
     if(sscanf(buf, "%u\n", &data) == 1) 
 	{
-	    if (data == 1) 
+	    if (data == FSYNC_MODE_ON) 
 		{
 		    pr_info("%s: FSYNCCONTROL fsync enabled\n", __FUNCTION__);
 
-		    fsync_enabled = true;
-
+		    fsync_mode = FSYNC_MODE_ON;
 		} 
-	    else if (data == 0) 
+	    else if (data == FSYNC_MODE_OFF) 
 		{
 		    pr_info("%s: FSYNCCONTROL fsync disabled\n", __FUNCTION__);
 
-		    fsync_enabled = false;
+		    fsync_mode = FSYNC_MODE_OFF;
+		} 
+	    else if (data == FSYNC_MODE_DEFERRED) 
+		{
+		    pr_info("%s: FSYNCCONTROL fsync deferred\n", __FUNCTION__);
+
+		    fsync_mode = FSYNC_MODE_DEFERRED;
+		} 
+	    else 
+		{
+		    pr_info("%s: invalid input range %u\n", __FUNCTION__, data);
+		}
+
+	    /* leaving deferred mode must not leave syncs behind */
+	    if (fsync_mode != FSYNC_MODE_DEFERRED)
+		fsynccontrol_flush_now();
+	} 
+    else 
+	{
+	    pr_info("%s: invalid input\n", __FUNCTION__);
+	}
+
+    return size;
+}
+
+static ssize_t fsynccontrol_delay_read(struct device * dev, struct device_attribute * attr, char * buf)
+{
+    return sprintf(buf, "%u\n", fsync_delay_ms);
+}
+
+static ssize_t fsynccontrol_delay_write(struct device * dev, struct device_attribute * attr, const char * buf, size_t size)
+{
+    unsigned int data;
+
+    if(sscanf(buf, "%u\n", &data) == 1) 
+	{
+	    if (data > 0 && data <= FSYNC_MAX_DELAY_MS) 
+		{
+		    pr_info("%s: FSYNCCONTROL fsync delay set to %ums\n", __FUNCTION__, data);
+
+		    fsync_delay_ms = data;
 		} 
 	    else 
 		{
@@ -64,11 +249,13 @@ static ssize_t fsynccontrol_version(struct device * dev, struct device_attribute
 }
 
 static DEVICE_ATTR(fsync_enabled, S_IRUGO | S_IWUGO, fsynccontrol_status_read, fsynccontrol_status_write);
+static DEVICE_ATTR(fsync_delay, S_IRUGO | S_IWUGO, fsynccontrol_delay_read, fsynccontrol_delay_write);
 static DEVICE_ATTR(version, S_IRUGO , fsynccontrol_version, NULL);
 
 static struct attribute *fsynccontrol_attributes[] = 
     {
 	&dev_attr_fsync_enabled.attr,
+	&dev_attr_fsync_delay.attr,
 	&dev_attr_version.attr,
 	NULL
     };
@@ -104,6 +291,9 @@ static int __init fsynccontrol_init(void)
 	    pr_err("Failed to create sysfs group for device (%s)!\n", fsynccontrol_device.name);
 	}
 
+    register_pm_notifier(&fsynccontrol_pm_nb);
+    register_reboot_notifier(&fsynccontrol_reboot_nb);
+
     return 0;
 }
 
@@ -20,11 +20,13 @@
 #include <linux/sched.h>
 #include <linux/module.h>
 #include <linux/fs.h>
+#include <linux/mm.h>
 #include <linux/miscdevice.h>
 #include <linux/uaccess.h>
 #include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/vmalloc.h>
 #include "logger.h"
 
 #include <asm/ioctls.h>
@@ -33,16 +35,29 @@
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting.
+ *
+ * Writers never hold a lock while copying their payload. A writer reserves
+ * space for its entry under the spinlock 'lock', which advances 'w_off', and
+ * then copies from user-space into the reserved region unlocked. Entries
+ * become visible to readers in reservation order once every earlier writer
+ * has finished, at which point 'c_off' is moved past them. Readers never look
+ * beyond 'c_off'.
+ *
+ * 'lock' protects the offsets, the list of in-flight writes and the readers'
+ * offsets. 'mutex' serializes readers against each other.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
+	wait_queue_head_t	wwq;	/* wait queue for writers out of room */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
-	size_t			w_off;	/* current write head offset */
+	struct list_head	writes;	/* in-flight writes, oldest first */
+	struct mutex		mutex;	/* mutex serializing readers */
+	spinlock_t		lock;	/* spinlock protecting offsets */
+	size_t			w_off;	/* current write (reservation) head */
+	size_t			c_off;	/* committed head, readers stop here */
 	size_t			head;	/* new readers start here */
 	size_t			size;	/* size of the log */
 };
@@ -51,7 +66,8 @@ struct logger_log {
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. 'r_off' is protected by log->lock; the rest of the
+ * structure, including the bounce buffer 'entry', by log->mutex.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
@@ -59,11 +75,28 @@ struct logger_reader {
 	size_t			r_off;	/* current read head offset */
 	bool			r_all;	/* reader can read all entries */
 	int			r_ver;	/* reader ABI version */
+	unsigned char		entry[sizeof(struct logger_entry) +
+				      LOGGER_ENTRY_MAX_PAYLOAD];
+};
+
+/*
+ * struct logger_write - a write in flight between reservation and commit
+ *
+ * Lives on the writer's stack and is linked on log->writes under log->lock.
+ */
+struct logger_write {
+	struct list_head	list;	/* entry in logger_log's writes */
+	size_t			end;	/* offset just past this entry */
+	bool			done;	/* payload copied, ready to commit */
 };
 
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
 #define logger_offset(n)	((n) & (log->size - 1))
 
+/* the largest entry a writer can produce, header included */
+#define LOGGER_ENTRY_MAX_LEN \
+	(sizeof(struct logger_entry) + LOGGER_ENTRY_MAX_PAYLOAD)
+
 /*
  * file_get_log - Given a file structure, return the associated log
  *
@@ -112,7 +145,7 @@ static struct logger_entry *get_entry_header(struct logger_log *log,
  * get_entry_msg_len - Grabs the length of the message of the entry
  * starting from from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->lock.
  */
 static __u32 get_entry_msg_len(struct logger_log *log, size_t off)
 {
@@ -156,64 +189,66 @@ static ssize_t copy_header_to_user(int ver, struct logger_entry *entry,
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * do_read_log - copies the entry at the reader's offset, header and payload,
+ * into the reader's bounce buffer. Returns the offset of the following entry.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static size_t do_read_log(struct logger_log *log, struct logger_reader *reader)
 {
-	struct logger_entry scratch;
-	struct logger_entry *entry;
+	size_t count;
 	size_t len;
-	size_t msg_start;
+
+	count = sizeof(struct logger_entry) +
+		get_entry_msg_len(log, reader->r_off);
+
+	len = min(count, log->size - reader->r_off);
+	memcpy(reader->entry, log->buffer + reader->r_off, len);
+
+	if (count != len)
+		memcpy(reader->entry + len, log->buffer, count - len);
+
+	return logger_offset(reader->r_off + count);
+}
+
+/*
+ * do_read_log_to_user - copies the entry held in the reader's bounce buffer
+ * into the user-space buffer 'buf'. Returns the number of bytes copied on
+ * success.
+ *
+ * Caller must hold log->mutex.
+ */
+static ssize_t do_read_log_to_user(struct logger_reader *reader,
+				   char __user *buf)
+{
+	struct logger_entry *entry = (struct logger_entry *) reader->entry;
 
 	/*
 	 * First, copy the header to userspace, using the version of
 	 * the header requested
 	 */
-	entry = get_entry_header(log, reader->r_off, &scratch);
 	if (copy_header_to_user(reader->r_ver, entry, buf))
 		return -EFAULT;
 
-	count -= get_user_hdr_len(reader->r_ver);
 	buf += get_user_hdr_len(reader->r_ver);
-	msg_start = logger_offset(reader->r_off + sizeof(struct logger_entry));
 
-	/*
-	 * We read from the msg in two disjoint operations. First, we read from
-	 * the current msg head offset up to 'count' bytes or to the end of
-	 * the log, whichever comes first.
-	 */
-	len = min(count, log->size - msg_start);
-	if (copy_to_user(buf, log->buffer + msg_start, len))
+	/* then the payload, which is contiguous in the bounce buffer */
+	if (copy_to_user(buf, entry->msg, entry->len))
 		return -EFAULT;
 
-	/*
-	 * Second, we read any remaining bytes, starting back at the head of
-	 * the log.
-	 */
-	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
-
-	reader->r_off = logger_offset(reader->r_off +
-		sizeof(struct logger_entry) + count);
-
-	return count + get_user_hdr_len(reader->r_ver);
+	return get_user_hdr_len(reader->r_ver) + entry->len;
 }
 
 /*
  * get_next_entry_by_uid - Starting at 'off', returns an offset into
  * 'log->buffer' which contains the first entry readable by 'euid'
+ *
+ * Caller must hold log->lock.
  */
 static size_t get_next_entry_by_uid(struct logger_log *log,
 		size_t off, uid_t euid)
 {
-	while (off != log->w_off) {
+	while (off != log->c_off) {
 		struct logger_entry *entry;
 		struct logger_entry scratch;
 		size_t next_len;
@@ -241,12 +276,16 @@ static size_t get_next_entry_by_uid(struct logger_log *log,
  *
  * Will set errno to EINVAL if read
  * buffer is insufficient to hold next entry.
+ *
+ * The entry is snapshotted into the reader's bounce buffer under log->lock
+ * so that writers are never held up by a faulting copy_to_user().
  */
 static ssize_t logger_read(struct file *file, char __user *buf,
 			   size_t count, loff_t *pos)
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	size_t off, next;
 	ssize_t ret;
 	DEFINE_WAIT(wait);
 
@@ -254,9 +293,9 @@ start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		spin_lock(&log->lock);
+		ret = (log->c_off == reader->r_off);
+		spin_unlock(&log->lock);
 		if (!ret)
 			break;
 
@@ -278,13 +317,15 @@ start:
 		return ret;
 
 	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 
 	if (!reader->r_all)
 		reader->r_off = get_next_entry_by_uid(log,
 			reader->r_off, current_euid());
 
 	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
+	if (unlikely(log->c_off == reader->r_off)) {
+		spin_unlock(&log->lock);
 		mutex_unlock(&log->mutex);
 		goto start;
 	}
@@ -293,12 +334,26 @@ start:
 	ret = get_user_hdr_len(reader->r_ver) +
 		get_entry_msg_len(log, reader->r_off);
 	if (count < ret) {
+		spin_unlock(&log->lock);
 		ret = -EINVAL;
 		goto out;
 	}
 
-	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	/* snapshot exactly one entry from the log */
+	off = reader->r_off;
+	next = do_read_log(log, reader);
+
+	spin_unlock(&log->lock);
+
+	ret = do_read_log_to_user(reader, buf);
+	if (ret < 0)
+		goto out;
+
+	/* consume the entry, unless a writer lapped us in the meantime */
+	spin_lock(&log->lock);
+	if (reader->r_off == off)
+		reader->r_off = next;
+	spin_unlock(&log->lock);
 
 out:
 	mutex_unlock(&log->mutex);
@@ -310,7 +365,7 @@ out:
  * get_next_entry - return the offset of the first valid entry at least 'len'
  * bytes after 'off'.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
 static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
 {
@@ -347,9 +402,10 @@ static inline int clock_interval(size_t a, size_t b, size_t c)
  * fix_up_readers - walk the list of all readers and "fix up" any who were
  * lapped by the writer; also do the same for the default "start head".
  * We do this by "pulling forward" the readers and start head to the first
- * entry after the new write head.
+ * entry after the new write head, which lands less than
+ * LOGGER_ENTRY_MAX_LEN bytes past it.
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void fix_up_readers(struct logger_log *log, size_t len)
 {
@@ -358,17 +414,19 @@ static void fix_up_readers(struct logger_log *log, size_t len)
 	struct logger_reader *reader;
 
 	if (clock_interval(old, new, log->head))
-		log->head = get_next_entry(log, log->head, len);
+		log->head = get_next_entry(log, log->head,
+					   logger_offset(new - log->head));
 
 	list_for_each_entry(reader, &log->readers, list)
 		if (clock_interval(old, new, reader->r_off))
-			reader->r_off = get_next_entry(log, reader->r_off, len);
+			reader->r_off = get_next_entry(log, reader->r_off,
+					logger_offset(new - reader->r_off));
 }
 
 /*
  * do_write_log - writes 'len' bytes from 'buf' to 'log'
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void do_write_log(struct logger_log *log, const void *buf, size_t count)
 {
@@ -386,42 +444,152 @@ static void do_write_log(struct logger_log *log, const void *buf, size_t count)
 
 /*
  * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
+ * the log 'log' at offset 'off', which the caller has reserved
  *
- * The caller needs to hold log->mutex.
+ * Called without log->lock held; the reserved region is not visible to
+ * readers until the write is committed.
  *
  * Returns 'count' on success, negative error code on failure.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
+static ssize_t do_write_log_from_user(struct logger_log *log, size_t off,
 				      const void __user *buf, size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
+	len = min(count, log->size - off);
+	if (len && copy_from_user(log->buffer + off, buf, len))
 		return -EFAULT;
 
 	if (count != len)
 		if (copy_from_user(log->buffer, buf + len, count - len))
 			return -EFAULT;
 
-	log->w_off = logger_offset(log->w_off + count);
-
 	return count;
 }
 
+/*
+ * do_clear_log - zeroes 'count' bytes of reserved payload at offset 'off'
+ *
+ * Used when copying from user-space fails half way: the entry has already
+ * been reserved, and possibly followed by other writers, so it cannot be
+ * unwound and is committed with a blank payload instead.
+ */
+static void do_clear_log(struct logger_log *log, size_t off, size_t count)
+{
+	size_t len;
+
+	len = min(count, log->size - off);
+	memset(log->buffer + off, 0, len);
+
+	if (count != len)
+		memset(log->buffer, 0, count - len);
+}
+
+/*
+ * log_pending - number of bytes reserved by writers but not yet committed
+ *
+ * The caller needs to hold log->lock.
+ */
+static inline size_t log_pending(struct logger_log *log)
+{
+	return logger_offset(log->w_off - log->c_off);
+}
+
+/*
+ * log_reserve - reserves room for an entry of 'len' bytes, header included,
+ * and writes the header. Returns the offset of the entry's payload.
+ *
+ * Readers are fixed up here, under log->lock, so that the header walk in
+ * fix_up_readers() only ever sees complete headers. If in-flight writes
+ * already cover most of the log, we wait for them to commit rather than
+ * lapping a region that is still being copied into. The fix-up may pull a
+ * reader up to LOGGER_ENTRY_MAX_LEN bytes past the new entry, so that much
+ * headroom is kept ahead of 'c_off' too.
+ */
+static size_t log_reserve(struct logger_log *log, struct logger_write *w,
+			  struct logger_entry *header)
+{
+	size_t len = sizeof(struct logger_entry) + header->len;
+	size_t off;
+
+	spin_lock(&log->lock);
+	while (unlikely(log_pending(log) + len + LOGGER_ENTRY_MAX_LEN >=
+			log->size)) {
+		spin_unlock(&log->lock);
+		wait_event(log->wwq, log_pending(log) + len +
+			   LOGGER_ENTRY_MAX_LEN < log->size);
+		spin_lock(&log->lock);
+	}
+
+	/*
+	 * Fix up any readers, pulling them forward to the first readable
+	 * entry after (what will be) the new write offset.
+	 */
+	fix_up_readers(log, len);
+
+	do_write_log(log, header, sizeof(struct logger_entry));
+	off = log->w_off;
+	log->w_off = logger_offset(log->w_off + header->len);
+
+	w->end = log->w_off;
+	w->done = false;
+	list_add_tail(&w->list, &log->writes);
+	spin_unlock(&log->lock);
+
+	return off;
+}
+
+/*
+ * log_commit - marks the write 'w' as complete and publishes every completed
+ * write at the front of log->writes to readers. Returns true if 'c_off'
+ * moved, i.e. if readers have something new to read.
+ */
+static bool log_commit(struct logger_log *log, struct logger_write *w)
+{
+	bool moved = false;
+
+	spin_lock(&log->lock);
+	w->done = true;
+	while (!list_empty(&log->writes)) {
+		struct logger_write *first;
+
+		first = list_first_entry(&log->writes, struct logger_write,
+					 list);
+		if (!first->done)
+			break;
+
+		log->c_off = first->end;
+		list_del(&first->list);
+		moved = true;
+	}
+	spin_unlock(&log->lock);
+
+	/*
+	 * Order the c_off update before the waitqueue check, pairing with
+	 * the barrier in wait_event()'s prepare_to_wait(); otherwise a writer
+	 * in log_reserve() could miss its wakeup and sleep forever.
+	 */
+	smp_mb();
+	if (moved && waitqueue_active(&log->wwq))
+		wake_up(&log->wwq);
+
+	return moved;
+}
+
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
- * them above all else.
+ * them above all else: concurrent writers only serialize on the brief
+ * reservation and commit steps, never on the copy from user-space.
  */
 ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
+	struct logger_write w;
 	struct timespec now;
+	size_t off;
 	ssize_t ret = 0;
 
 	now = current_kernel_time();
@@ -438,17 +606,7 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
-
-	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
-	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
-
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	off = log_reserve(log, &w, &header);
 
 	while (nr_segs-- > 0) {
 		size_t len;
@@ -458,21 +616,21 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 		len = min_t(size_t, iov->iov_len, header.len - ret);
 
 		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
+		nr = do_write_log_from_user(log, logger_offset(off + ret),
+					    iov->iov_base, len);
 		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
+			do_clear_log(log, off, header.len);
+			ret = nr;
+			break;
 		}
 
 		iov++;
 		ret += nr;
 	}
 
-	mutex_unlock(&log->mutex);
-
 	/* wake up any blocked readers */
-	wake_up_interruptible(&log->wq);
+	if (log_commit(log, &w))
+		wake_up_interruptible(&log->wq);
 
 	return ret;
 }
@@ -511,10 +669,10 @@ static int logger_open(struct inode *inode, struct file *file)
 
 		INIT_LIST_HEAD(&reader->list);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		reader->r_off = log->head;
 		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
 		file->private_data = reader;
 	} else
@@ -532,7 +690,11 @@ static int logger_release(struct inode *ignored, struct file *file)
 {
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader = file->private_data;
+		struct logger_log *log = reader->log;
+
+		spin_lock(&log->lock);
 		list_del(&reader->list);
+		spin_unlock(&log->lock);
 		kfree(reader);
 	}
 
@@ -562,14 +724,14 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 	if (!reader->r_all)
 		reader->r_off = get_next_entry_by_uid(log,
 			reader->r_off, current_euid());
 
-	if (log->w_off != reader->r_off)
+	if (log->c_off != reader->r_off)
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -587,6 +749,53 @@ static long logger_set_version(struct logger_reader *reader, void __user *arg)
 	return 0;
 }
 
+static long logger_get_offsets(struct logger_reader *reader, void __user *arg)
+{
+	struct logger_log *log = reader->log;
+	struct logger_offsets offsets;
+
+	spin_lock(&log->lock);
+	if (!reader->r_all)
+		reader->r_off = get_next_entry_by_uid(log,
+			reader->r_off, current_euid());
+	offsets.head = log->c_off;
+	offsets.r_off = reader->r_off;
+	spin_unlock(&log->lock);
+
+	if (copy_to_user(arg, &offsets, sizeof(offsets)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/*
+ * logger_set_read_offset - moves the reader forward to 'off', which must be
+ * an entry boundary between the reader's offset and the committed head. We
+ * walk the entries to check, as a bogus offset would send the entry walks
+ * off into the weeds.
+ *
+ * Caller must hold log->lock.
+ */
+static long logger_set_read_offset(struct logger_reader *reader,
+				   unsigned long off)
+{
+	struct logger_log *log = reader->log;
+	size_t pos = reader->r_off;
+
+	if (off >= log->size)
+		return -EINVAL;
+
+	while (pos != off) {
+		if (pos == log->c_off)
+			return -EINVAL;
+		pos = logger_offset(pos + sizeof(struct logger_entry) +
+				    get_entry_msg_len(log, pos));
+	}
+
+	reader->r_off = pos;
+	return 0;
+}
+
 static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct logger_log *log = file_get_log(file);
@@ -606,10 +815,12 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
+		spin_lock(&log->lock);
+		if (log->c_off >= reader->r_off)
+			ret = log->c_off - reader->r_off;
 		else
-			ret = (log->size - reader->r_off) + log->w_off;
+			ret = (log->size - reader->r_off) + log->c_off;
+		spin_unlock(&log->lock);
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
 		if (!(file->f_mode & FMODE_READ)) {
@@ -618,24 +829,28 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		}
 		reader = file->private_data;
 
+		spin_lock(&log->lock);
 		if (!reader->r_all)
 			reader->r_off = get_next_entry_by_uid(log,
 				reader->r_off, current_euid());
 
-		if (log->w_off != reader->r_off)
+		if (log->c_off != reader->r_off)
 			ret = get_user_hdr_len(reader->r_ver) +
 				get_entry_msg_len(log, reader->r_off);
 		else
 			ret = 0;
+		spin_unlock(&log->lock);
 		break;
 	case LOGGER_FLUSH_LOG:
 		if (!(file->f_mode & FMODE_WRITE)) {
 			ret = -EBADF;
 			break;
 		}
+		spin_lock(&log->lock);
 		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+			reader->r_off = log->c_off;
+		log->head = log->c_off;
+		spin_unlock(&log->lock);
 		ret = 0;
 		break;
 	case LOGGER_GET_VERSION:
@@ -654,6 +869,24 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		reader = file->private_data;
 		ret = logger_set_version(reader, argp);
 		break;
+	case LOGGER_GET_OFFSETS:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		ret = logger_get_offsets(reader, argp);
+		break;
+	case LOGGER_SET_READ_OFFSET:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		spin_lock(&log->lock);
+		ret = logger_set_read_offset(reader, arg);
+		spin_unlock(&log->lock);
+		break;
 	}
 
 	mutex_unlock(&log->mutex);
@@ -661,11 +894,47 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	return ret;
 }
 
+/*
+ * logger_mmap - the log's mmap file operation
+ *
+ * Maps the whole ring read-only, so that bulk consumers can parse entries in
+ * place instead of paying a read() per entry. See struct logger_offsets for
+ * the protocol. As the mapping bypasses the per-uid filtering done by
+ * read(), it is only offered to readers that may read every entry.
+ */
+static int logger_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct logger_reader *reader;
+	struct logger_log *log;
+	unsigned long size = vma->vm_end - vma->vm_start;
+
+	if (!(file->f_mode & FMODE_READ))
+		return -EBADF;
+
+	reader = file->private_data;
+	log = reader->log;
+
+	if (!reader->r_all)
+		return -EPERM;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	if (vma->vm_pgoff || size != PAGE_ALIGN(log->size))
+		return -EINVAL;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTEXPAND;
+
+	return remap_vmalloc_range(vma, log->buffer, 0);
+}
+
 static const struct file_operations logger_fops = {
 	.owner = THIS_MODULE,
 	.read = logger_read,
 	.aio_write = logger_aio_write,
 	.poll = logger_poll,
+	.mmap = logger_mmap,
 	.unlocked_ioctl = logger_ioctl,
 	.compat_ioctl = logger_ioctl,
 	.open = logger_open,
@@ -674,13 +943,11 @@ static const struct file_operations logger_fops = {
 
 /*
  * Defines a log structure with name 'NAME' and a size of 'SIZE' bytes, which
- * must be a power of two, and greater than
- * (LOGGER_ENTRY_MAX_PAYLOAD + sizeof(struct logger_entry)).
+ * must be a power of two, and greater than twice LOGGER_ENTRY_MAX_LEN. The
+ * buffer itself is allocated by init_log().
  */
 #define DEFINE_LOGGER_DEVICE(VAR, NAME, SIZE) \
-static unsigned char _buf_ ## VAR[SIZE]; \
 static struct logger_log VAR = { \
-	.buffer = _buf_ ## VAR, \
 	.misc = { \
 		.minor = MISC_DYNAMIC_MINOR, \
 		.name = NAME, \
@@ -688,9 +955,13 @@ static struct logger_log VAR = { \
 		.parent = NULL, \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
+	.wwq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wwq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
+	.writes = LIST_HEAD_INIT(VAR .writes), \
 	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
 	.w_off = 0, \
+	.c_off = 0, \
 	.head = 0, \
 	.size = SIZE, \
 };
@@ -713,14 +984,28 @@ static struct logger_log *get_log_from_minor(int minor)
 	return NULL;
 }
 
+/*
+ * The ring comes from vmalloc_user() rather than static storage: that is
+ * what lets logger_mmap() hand its pages to userspace whether the logger
+ * is built in or a module, and it starts out zeroed.
+ */
 static int __init init_log(struct logger_log *log)
 {
 	int ret;
 
+	log->buffer = vmalloc_user(log->size);
+	if (unlikely(!log->buffer)) {
+		printk(KERN_ERR "logger: failed to allocate buffer "
+		       "for log '%s'!\n", log->misc.name);
+		return -ENOMEM;
+	}
+
 	ret = misc_register(&log->misc);
 	if (unlikely(ret)) {
 		printk(KERN_ERR "logger: failed to register misc "
 		       "device for log '%s'!\n", log->misc.name);
+		vfree(log->buffer);
+		log->buffer = NULL;
 		return ret;
 	}
 
@@ -51,6 +51,19 @@ struct logger_entry {
 	char		msg[0];		/* the entry's payload */
 };
 
+/*
+ * Offsets into the ring mapped by mmap(), returned by LOGGER_GET_OFFSETS.
+ * Entries between 'r_off' and 'head' are complete and may be parsed in
+ * place; they always carry the version 2 header, wrapping at the end of
+ * the ring. If 'r_off' has moved when re-read after parsing, a writer has
+ * lapped the reader and the entries before the new 'r_off' must be
+ * discarded. LOGGER_SET_READ_OFFSET then consumes up to the 'head' seen.
+ */
+struct logger_offsets {
+	__u32		head;	/* committed write head */
+	__u32		r_off;	/* this reader's offset */
+};
+
 #define LOGGER_LOG_RADIO	"log_radio"	/* radio-related messages */
 #define LOGGER_LOG_EVENTS	"log_events"	/* system/hardware events */
 #define LOGGER_LOG_SYSTEM	"log_system"	/* system/framework messages */
@@ -66,5 +79,7 @@ struct logger_entry {
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) /* flush log */
 #define LOGGER_GET_VERSION		_IO(__LOGGERIO, 5) /* abi version */
 #define LOGGER_SET_VERSION		_IO(__LOGGERIO, 6) /* abi version */
+#define LOGGER_GET_OFFSETS		_IOR(__LOGGERIO, 7, struct logger_offsets)
+#define LOGGER_SET_READ_OFFSET		_IO(__LOGGERIO, 8) /* consume */
 
 #endif /* _LINUX_LOGGER_H */
@@ -94,32 +94,62 @@ struct zbud_page {
 				CHUNK_MASK) >> CHUNK_SHIFT)
 #define MAX_CHUNK	(NCHUNKS-1)
 
+/*
+ * Each unbuddied list has its own lock, and the buddied list has another,
+ * so that puts and flushes of different sizes don't contend.  A list lock
+ * nests inside a zbpg's lock, or is taken first and the zbpg's lock only
+ * trylocked.
+ */
 static struct {
 	struct list_head list;
 	unsigned count;
-} zbud_unbuddied[NCHUNKS];
+	spinlock_t lock;
+} ____cacheline_aligned_in_smp zbud_unbuddied[NCHUNKS];
 /* list N contains pages with N chunks USED and NCHUNKS-N unused */
 /* element 0 is never used but optimizing that isn't worth it */
-static unsigned long zbud_cumul_chunk_counts[NCHUNKS];
+static DEFINE_PER_CPU(unsigned long [NCHUNKS], zbud_cumul_chunk_counts);
 
 struct list_head zbud_buddied_list;
 static unsigned long zcache_zbud_buddied_count;
 
-/* protects the buddied list and all unbuddied lists */
-static DEFINE_SPINLOCK(zbud_budlists_spinlock);
+/* protects the buddied list */
+static DEFINE_SPINLOCK(zbud_buddied_spinlock);
 
 static LIST_HEAD(zbpg_unused_list);
-static unsigned long zcache_zbpg_unused_list_count;
+static unsigned long zbpg_unused_list_count;
 
 /* protects the unused page list */
 static DEFINE_SPINLOCK(zbpg_unused_list_spinlock);
 
+/*
+ * Unused raw pages are first recycled through a small per-cpu stash,
+ * accessed with interrupts off on the owning cpu only, so that freeing a
+ * zbpg and allocating one again soon after needs no shared lock.  Only
+ * the overflow goes to the global unused list.
+ */
+#define ZBPG_UNUSED_PCP_MAX 8
+
+struct zbpg_unused_pcp {
+	struct list_head list;
+	unsigned count;
+};
+static DEFINE_PER_CPU(struct zbpg_unused_pcp, zbpg_unused_pcp);
+
 static atomic_t zcache_zbud_curr_raw_pages;
 static atomic_t zcache_zbud_curr_zpages;
-static unsigned long zcache_zbud_curr_zbytes;
-static unsigned long zcache_zbud_cumul_zpages;
-static unsigned long zcache_zbud_cumul_zbytes;
-static unsigned long zcache_compress_poor;
+
+/*
+ * Statistics counters are per-cpu, and only summed when read through
+ * sysfs, so that updating them doesn't bounce a shared cacheline.
+ */
+static DEFINE_PER_CPU(unsigned long, zcache_zbud_curr_zbytes);
+static DEFINE_PER_CPU(unsigned long, zcache_zbud_cumul_zpages);
+static DEFINE_PER_CPU(unsigned long, zcache_zbud_cumul_zbytes);
+static DEFINE_PER_CPU(unsigned long, zcache_compress_poor);
+
+#define zcache_stat_inc(_name)		this_cpu_inc(zcache_##_name)
+#define zcache_stat_add(_name, _n)	this_cpu_add(zcache_##_name, _n)
+#define zcache_stat_sub(_name, _n)	this_cpu_sub(zcache_##_name, _n)
 
 /* forward references */
 static void *zcache_get_free_page(void);
@@ -180,23 +210,45 @@ static char *zbud_data(struct zbud_hdr *zh, unsigned size)
  * zbud raw page management
  */
 
+/* take an unused zbpg from this cpu's stash, if it has one */
+static struct zbud_page *zbpg_unused_pcp_get(void)
+{
+	struct zbpg_unused_pcp *pcp;
+	struct zbud_page *zbpg = NULL;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	pcp = &__get_cpu_var(zbpg_unused_pcp);
+	if (!list_empty(&pcp->list)) {
+		zbpg = list_first_entry(&pcp->list, struct zbud_page, bud_list);
+		list_del_init(&zbpg->bud_list);
+		pcp->count--;
+	}
+	local_irq_restore(flags);
+	return zbpg;
+}
+
 static struct zbud_page *zbud_alloc_raw_page(void)
 {
 	struct zbud_page *zbpg = NULL;
 	struct zbud_hdr *zh0, *zh1;
 	bool recycled = 0;
 
-	/* if any pages on the zbpg list, use one */
-	spin_lock(&zbpg_unused_list_spinlock);
-	if (!list_empty(&zbpg_unused_list)) {
-		zbpg = list_first_entry(&zbpg_unused_list,
-				struct zbud_page, bud_list);
-		list_del_init(&zbpg->bud_list);
-		zcache_zbpg_unused_list_count--;
-		recycled = 1;
+	/* if any pages on this cpu's stash or the zbpg list, use one */
+	zbpg = zbpg_unused_pcp_get();
+	if (zbpg == NULL) {
+		spin_lock(&zbpg_unused_list_spinlock);
+		if (!list_empty(&zbpg_unused_list)) {
+			zbpg = list_first_entry(&zbpg_unused_list,
+					struct zbud_page, bud_list);
+			list_del_init(&zbpg->bud_list);
+			zbpg_unused_list_count--;
+		}
+		spin_unlock(&zbpg_unused_list_spinlock);
 	}
-	spin_unlock(&zbpg_unused_list_spinlock);
-	if (zbpg == NULL)
+	if (zbpg != NULL)
+		recycled = 1;
+	else
 		/* none on zbpg list, try to get a kernel page */
 		zbpg = zcache_get_free_page();
 	if (likely(zbpg != NULL)) {
@@ -223,6 +275,8 @@ static struct zbud_page *zbud_alloc_raw_page(void)
 static void zbud_free_raw_page(struct zbud_page *zbpg)
 {
 	struct zbud_hdr *zh0 = &zbpg->buddy[0], *zh1 = &zbpg->buddy[1];
+	struct zbpg_unused_pcp *pcp;
+	unsigned long flags;
 
 	ASSERT_SENTINEL(zbpg, ZBPG);
 	BUG_ON(!list_empty(&zbpg->bud_list));
@@ -231,9 +285,19 @@ static void zbud_free_raw_page(struct zbud_page *zbpg)
 	BUG_ON(zh1->size != 0 || tmem_oid_valid(&zh1->oid));
 	INVERT_SENTINEL(zbpg, ZBPG);
 	spin_unlock(&zbpg->lock);
+	local_irq_save(flags);
+	pcp = &__get_cpu_var(zbpg_unused_pcp);
+	if (pcp->count < ZBPG_UNUSED_PCP_MAX) {
+		list_add(&zbpg->bud_list, &pcp->list);
+		pcp->count++;
+		zbpg = NULL;
+	}
+	local_irq_restore(flags);
+	if (zbpg == NULL)
+		return;
 	spin_lock(&zbpg_unused_list_spinlock);
 	list_add(&zbpg->bud_list, &zbpg_unused_list);
-	zcache_zbpg_unused_list_count++;
+	zbpg_unused_list_count++;
 	spin_unlock(&zbpg_unused_list_spinlock);
 }
 
@@ -252,7 +316,7 @@ static unsigned zbud_free(struct zbud_hdr *zh)
 	zh->size = 0;
 	tmem_oid_set_invalid(&zh->oid);
 	INVERT_SENTINEL(zh, ZBH);
-	zcache_zbud_curr_zbytes -= size;
+	zcache_stat_sub(zbud_curr_zbytes, size);
 	atomic_dec(&zcache_zbud_curr_zpages);
 	return size;
 }
@@ -276,20 +340,22 @@ static void zbud_free_and_delist(struct zbud_hdr *zh)
 	zh_other = &zbpg->buddy[(budnum == 0) ? 1 : 0];
 	if (zh_other->size == 0) { /* was unbuddied: unlist and free */
 		chunks = zbud_size_to_chunks(size) ;
-		spin_lock(&zbud_budlists_spinlock);
+		spin_lock(&zbud_unbuddied[chunks].lock);
 		BUG_ON(list_empty(&zbud_unbuddied[chunks].list));
 		list_del_init(&zbpg->bud_list);
 		zbud_unbuddied[chunks].count--;
-		spin_unlock(&zbud_budlists_spinlock);
+		spin_unlock(&zbud_unbuddied[chunks].lock);
 		zbud_free_raw_page(zbpg);
 	} else { /* was buddied: move remaining buddy to unbuddied list */
 		chunks = zbud_size_to_chunks(zh_other->size) ;
-		spin_lock(&zbud_budlists_spinlock);
+		spin_lock(&zbud_buddied_spinlock);
 		list_del_init(&zbpg->bud_list);
 		zcache_zbud_buddied_count--;
+		spin_unlock(&zbud_buddied_spinlock);
+		spin_lock(&zbud_unbuddied[chunks].lock);
 		list_add_tail(&zbpg->bud_list, &zbud_unbuddied[chunks].list);
 		zbud_unbuddied[chunks].count++;
-		spin_unlock(&zbud_budlists_spinlock);
+		spin_unlock(&zbud_unbuddied[chunks].lock);
 		spin_unlock(&zbpg->lock);
 	}
 }
@@ -306,17 +372,18 @@ static struct zbud_hdr *zbud_create(uint32_t pool_id, struct tmem_oid *oid,
 
 	nchunks = zbud_size_to_chunks(size) ;
 	for (i = MAX_CHUNK - nchunks + 1; i > 0; i--) {
-		spin_lock(&zbud_budlists_spinlock);
-		if (!list_empty(&zbud_unbuddied[i].list)) {
-			list_for_each_entry_safe(zbpg, ztmp,
-				    &zbud_unbuddied[i].list, bud_list) {
-				if (spin_trylock(&zbpg->lock)) {
-					found_good_buddy = i;
-					goto found_unbuddied;
-				}
+		/* racy peek, saves taking the locks of empty lists */
+		if (list_empty(&zbud_unbuddied[i].list))
+			continue;
+		spin_lock(&zbud_unbuddied[i].lock);
+		list_for_each_entry_safe(zbpg, ztmp,
+			    &zbud_unbuddied[i].list, bud_list) {
+			if (spin_trylock(&zbpg->lock)) {
+				found_good_buddy = i;
+				goto found_unbuddied;
 			}
 		}
-		spin_unlock(&zbud_budlists_spinlock);
+		spin_unlock(&zbud_unbuddied[i].lock);
 	}
 	/* didn't find a good buddy, try allocating a new page */
 	zbpg = zbud_alloc_raw_page();
@@ -324,9 +391,10 @@ static struct zbud_hdr *zbud_create(uint32_t pool_id, struct tmem_oid *oid,
 		goto out;
 	/* ok, have a page, now compress the data before taking locks */
 	spin_lock(&zbpg->lock);
-	spin_lock(&zbud_budlists_spinlock);
+	spin_lock(&zbud_unbuddied[nchunks].lock);
 	list_add_tail(&zbpg->bud_list, &zbud_unbuddied[nchunks].list);
 	zbud_unbuddied[nchunks].count++;
+	spin_unlock(&zbud_unbuddied[nchunks].lock);
 	zh = &zbpg->buddy[0];
 	goto init_zh;
 
@@ -344,26 +412,28 @@ found_unbuddied:
 		BUG();
 	list_del_init(&zbpg->bud_list);
 	zbud_unbuddied[found_good_buddy].count--;
+	spin_unlock(&zbud_unbuddied[found_good_buddy].lock);
+	spin_lock(&zbud_buddied_spinlock);
 	list_add_tail(&zbpg->bud_list, &zbud_buddied_list);
 	zcache_zbud_buddied_count++;
+	spin_unlock(&zbud_buddied_spinlock);
 
 init_zh:
+	/* the zbpg's lock is all that's needed from here on */
 	SET_SENTINEL(zh, ZBH);
 	zh->size = size;
 	zh->index = index;
 	zh->oid = *oid;
 	zh->pool_id = pool_id;
-	/* can wait to copy the data until the list locks are dropped */
-	spin_unlock(&zbud_budlists_spinlock);
 
 	to = zbud_data(zh, size);
 	memcpy(to, cdata, size);
 	spin_unlock(&zbpg->lock);
-	zbud_cumul_chunk_counts[nchunks]++;
+	this_cpu_inc(zbud_cumul_chunk_counts[nchunks]);
 	atomic_inc(&zcache_zbud_curr_zpages);
-	zcache_zbud_cumul_zpages++;
-	zcache_zbud_curr_zbytes += size;
-	zcache_zbud_cumul_zbytes += size;
+	zcache_stat_inc(zbud_cumul_zpages);
+	zcache_stat_add(zbud_curr_zbytes, size);
+	zcache_stat_add(zbud_cumul_zbytes, size);
 out:
 	return zh;
 }
@@ -403,9 +473,9 @@ out:
  * pages "least valuable" first.
  */
 
-static unsigned long zcache_evicted_raw_pages;
-static unsigned long zcache_evicted_buddied_pages;
-static unsigned long zcache_evicted_unbuddied_pages;
+static DEFINE_PER_CPU(unsigned long, zcache_evicted_raw_pages);
+static DEFINE_PER_CPU(unsigned long, zcache_evicted_buddied_pages);
+static DEFINE_PER_CPU(unsigned long, zcache_evicted_unbuddied_pages);
 
 static struct tmem_pool *zcache_get_pool_by_id(uint32_t poolid);
 static void zcache_put_pool(struct tmem_pool *pool);
@@ -461,29 +531,34 @@ static void zbud_evict_pages(int nr)
 
 	/* first try freeing any pages on unused list */
 retry_unused_list:
+	zbpg = NULL;
 	spin_lock_bh(&zbpg_unused_list_spinlock);
 	if (!list_empty(&zbpg_unused_list)) {
 		/* can't walk list here, since it may change when unlocked */
 		zbpg = list_first_entry(&zbpg_unused_list,
 				struct zbud_page, bud_list);
 		list_del_init(&zbpg->bud_list);
-		zcache_zbpg_unused_list_count--;
+		zbpg_unused_list_count--;
+	}
+	spin_unlock_bh(&zbpg_unused_list_spinlock);
+	/* other cpus' stashes are theirs, but this one's can go too */
+	if (zbpg == NULL)
+		zbpg = zbpg_unused_pcp_get();
+	if (zbpg != NULL) {
 		atomic_dec(&zcache_zbud_curr_raw_pages);
-		spin_unlock_bh(&zbpg_unused_list_spinlock);
 		zcache_free_page(zbpg);
-		zcache_evicted_raw_pages++;
+		zcache_stat_inc(evicted_raw_pages);
 		if (--nr <= 0)
 			goto out;
 		goto retry_unused_list;
 	}
-	spin_unlock_bh(&zbpg_unused_list_spinlock);
 
 	/* now try freeing unbuddied pages, starting with least space avail */
 	for (i = 0; i < MAX_CHUNK; i++) {
 retry_unbud_list_i:
-		spin_lock_bh(&zbud_budlists_spinlock);
+		spin_lock_bh(&zbud_unbuddied[i].lock);
 		if (list_empty(&zbud_unbuddied[i].list)) {
-			spin_unlock_bh(&zbud_budlists_spinlock);
+			spin_unlock_bh(&zbud_unbuddied[i].lock);
 			continue;
 		}
 		list_for_each_entry(zbpg, &zbud_unbuddied[i].list, bud_list) {
@@ -491,8 +566,8 @@ retry_unbud_list_i:
 				continue;
 			list_del_init(&zbpg->bud_list);
 			zbud_unbuddied[i].count--;
-			spin_unlock(&zbud_budlists_spinlock);
-			zcache_evicted_unbuddied_pages++;
+			spin_unlock(&zbud_unbuddied[i].lock);
+			zcache_stat_inc(evicted_unbuddied_pages);
 			/* want budlists unlocked when doing zbpg eviction */
 			zbud_evict_zbpg(zbpg);
 			local_bh_enable();
@@ -500,14 +575,14 @@ retry_unbud_list_i:
 				goto out;
 			goto retry_unbud_list_i;
 		}
-		spin_unlock_bh(&zbud_budlists_spinlock);
+		spin_unlock_bh(&zbud_unbuddied[i].lock);
 	}
 
 	/* as a last resort, free buddied pages */
 retry_bud_list:
-	spin_lock_bh(&zbud_budlists_spinlock);
+	spin_lock_bh(&zbud_buddied_spinlock);
 	if (list_empty(&zbud_buddied_list)) {
-		spin_unlock_bh(&zbud_budlists_spinlock);
+		spin_unlock_bh(&zbud_buddied_spinlock);
 		goto out;
 	}
 	list_for_each_entry(zbpg, &zbud_buddied_list, bud_list) {
@@ -515,8 +590,8 @@ retry_bud_list:
 			continue;
 		list_del_init(&zbpg->bud_list);
 		zcache_zbud_buddied_count--;
-		spin_unlock(&zbud_budlists_spinlock);
-		zcache_evicted_buddied_pages++;
+		spin_unlock(&zbud_buddied_spinlock);
+		zcache_stat_inc(evicted_buddied_pages);
 		/* want budlists unlocked when doing zbpg eviction */
 		zbud_evict_zbpg(zbpg);
 		local_bh_enable();
@@ -524,21 +599,36 @@ retry_bud_list:
 			goto out;
 		goto retry_bud_list;
 	}
-	spin_unlock_bh(&zbud_budlists_spinlock);
+	spin_unlock_bh(&zbud_buddied_spinlock);
 out:
 	return;
 }
 
+/* hand a dead cpu's stash of unused zbpgs over to the global list */
+static void zbpg_unused_pcp_drain(int cpu)
+{
+	struct zbpg_unused_pcp *pcp = &per_cpu(zbpg_unused_pcp, cpu);
+
+	spin_lock_bh(&zbpg_unused_list_spinlock);
+	list_splice_init(&pcp->list, &zbpg_unused_list);
+	zbpg_unused_list_count += pcp->count;
+	pcp->count = 0;
+	spin_unlock_bh(&zbpg_unused_list_spinlock);
+}
+
 static void zbud_init(void)
 {
-	int i;
+	int i, cpu;
 
 	INIT_LIST_HEAD(&zbud_buddied_list);
 	zcache_zbud_buddied_count = 0;
 	for (i = 0; i < NCHUNKS; i++) {
 		INIT_LIST_HEAD(&zbud_unbuddied[i].list);
 		zbud_unbuddied[i].count = 0;
+		spin_lock_init(&zbud_unbuddied[i].lock);
 	}
+	for_each_possible_cpu(cpu)
+		INIT_LIST_HEAD(&per_cpu(zbpg_unused_pcp, cpu).list);
 }
 
 #ifdef CONFIG_SYSFS
@@ -558,18 +648,33 @@ static int zbud_show_unbuddied_list_counts(char *buf)
 	return p - buf;
 }
 
+static int zbpg_show_unused_list_count(char *buf)
+{
+	unsigned long count = zbpg_unused_list_count;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		count += per_cpu(zbpg_unused_pcp, cpu).count;
+	return sprintf(buf, "%lu\n", count);
+}
+
 static int zbud_show_cumul_chunk_counts(char *buf)
 {
 	unsigned long i, chunks = 0, total_chunks = 0, sum_total_chunks = 0;
 	unsigned long total_chunks_lte_21 = 0, total_chunks_lte_32 = 0;
 	unsigned long total_chunks_lte_42 = 0;
+	unsigned long count;
 	char *p = buf;
+	int cpu;
 
 	for (i = 0; i < NCHUNKS; i++) {
-		p += sprintf(p, "%lu ", zbud_cumul_chunk_counts[i]);
-		chunks += zbud_cumul_chunk_counts[i];
-		total_chunks += zbud_cumul_chunk_counts[i];
-		sum_total_chunks += i * zbud_cumul_chunk_counts[i];
+		count = 0;
+		for_each_possible_cpu(cpu)
+			count += per_cpu(zbud_cumul_chunk_counts, cpu)[i];
+		p += sprintf(p, "%lu ", count);
+		chunks += count;
+		total_chunks += count;
+		sum_total_chunks += i * count;
 		if (i == 21)
 			total_chunks_lte_21 = total_chunks;
 		if (i == 32)
@@ -670,12 +775,12 @@ static void zv_decompress(struct page *page, struct zv_hdr *zv)
  */
 
 /* useful stats not collected by cleancache or frontswap */
-static unsigned long zcache_flush_total;
-static unsigned long zcache_flush_found;
-static unsigned long zcache_flobj_total;
-static unsigned long zcache_flobj_found;
-static unsigned long zcache_failed_eph_puts;
-static unsigned long zcache_failed_pers_puts;
+static DEFINE_PER_CPU(unsigned long, zcache_flush_total);
+static DEFINE_PER_CPU(unsigned long, zcache_flush_found);
+static DEFINE_PER_CPU(unsigned long, zcache_flobj_total);
+static DEFINE_PER_CPU(unsigned long, zcache_flobj_found);
+static DEFINE_PER_CPU(unsigned long, zcache_failed_eph_puts);
+static DEFINE_PER_CPU(unsigned long, zcache_failed_pers_puts);
 
 #define MAX_POOLS_PER_CLIENT 16
 
@@ -710,11 +815,11 @@ static void zcache_put_pool(struct tmem_pool *pool)
 }
 
 /* counters for debugging */
-static unsigned long zcache_failed_get_free_pages;
-static unsigned long zcache_failed_alloc;
-static unsigned long zcache_put_to_flush;
-static unsigned long zcache_aborted_preload;
-static unsigned long zcache_aborted_shrink;
+static DEFINE_PER_CPU(unsigned long, zcache_failed_get_free_pages);
+static DEFINE_PER_CPU(unsigned long, zcache_failed_alloc);
+static DEFINE_PER_CPU(unsigned long, zcache_put_to_flush);
+static DEFINE_PER_CPU(unsigned long, zcache_aborted_preload);
+static DEFINE_PER_CPU(unsigned long, zcache_aborted_shrink);
 
 /*
  * Ensure that memory allocation requests in zcache don't result
@@ -761,7 +866,7 @@ static int zcache_do_preload(struct tmem_pool *pool)
 	if (unlikely(zcache_obj_cache == NULL))
 		goto out;
 	if (!spin_trylock(&zcache_direct_reclaim_lock)) {
-		zcache_aborted_preload++;
+		zcache_stat_inc(aborted_preload);
 		goto out;
 	}
 	preempt_disable();
@@ -771,7 +876,7 @@ static int zcache_do_preload(struct tmem_pool *pool)
 		objnode = kmem_cache_alloc(zcache_objnode_cache,
 				ZCACHE_GFP_MASK);
 		if (unlikely(objnode == NULL)) {
-			zcache_failed_alloc++;
+			zcache_stat_inc(failed_alloc);
 			goto unlock_out;
 		}
 		preempt_disable();
@@ -784,12 +889,12 @@ static int zcache_do_preload(struct tmem_pool *pool)
 	preempt_enable_no_resched();
 	obj = kmem_cache_alloc(zcache_obj_cache, ZCACHE_GFP_MASK);
 	if (unlikely(obj == NULL)) {
-		zcache_failed_alloc++;
+		zcache_stat_inc(failed_alloc);
 		goto unlock_out;
 	}
 	page = (void *)__get_free_page(ZCACHE_GFP_MASK);
 	if (unlikely(page == NULL)) {
-		zcache_failed_get_free_pages++;
+		zcache_stat_inc(failed_get_free_pages);
 		kmem_cache_free(zcache_obj_cache, obj);
 		goto unlock_out;
 	}
@@ -916,7 +1021,7 @@ static void *zcache_pampd_create(struct tmem_pool *pool, struct tmem_oid *oid,
 
 			goto out;
 		if (clen == 0 || clen > zbud_max_buddy_size()) {
-			zcache_compress_poor++;
+			zcache_stat_inc(compress_poor);
 			goto out;
 		}
 		pampd = (void *)zbud_create(pool->pool_id, oid, index,
@@ -939,7 +1044,7 @@ static void *zcache_pampd_create(struct tmem_pool *pool, struct tmem_oid *oid,
 		if (ret == 0)
 			goto out;
 		if (clen > zv_max_page_size) {
-			zcache_compress_poor++;
+			zcache_stat_inc(compress_poor);
 			goto out;
 		}
 		pampd = (void *)zv_create(zcache_client.xvpool, pool->pool_id,
@@ -1055,6 +1160,8 @@ static int zcache_cpu_notifier(struct notifier_block *nb,
 		}
 		kmem_cache_free(zcache_obj_cache, kp->obj);
 		free_page((unsigned long)kp->page);
+		if (action == CPU_DEAD)
+			zbpg_unused_pcp_drain(cpu);
 		break;
 	default:
 		break;
@@ -1078,6 +1185,21 @@ static struct notifier_block zcache_cpu_notifier_block = {
 		.show = zcache_##_name##_show, \
 	}
 
+#define ZCACHE_SYSFS_RO_PERCPU(_name) \
+	static ssize_t zcache_##_name##_show(struct kobject *kobj, \
+				struct kobj_attribute *attr, char *buf) \
+	{ \
+		unsigned long sum = 0; \
+		int cpu; \
+		for_each_possible_cpu(cpu) \
+			sum += per_cpu(zcache_##_name, cpu); \
+		return sprintf(buf, "%lu\n", sum); \
+	} \
+	static struct kobj_attribute zcache_##_name##_attr = { \
+		.attr = { .name = __stringify(_name), .mode = 0444 }, \
+		.show = zcache_##_name##_show, \
+	}
+
 #define ZCACHE_SYSFS_RO_ATOMIC(_name) \
 	static ssize_t zcache_##_name##_show(struct kobject *kobj, \
 				struct kobj_attribute *attr, char *buf) \
@@ -1102,26 +1224,27 @@ static struct notifier_block zcache_cpu_notifier_block = {
 
 ZCACHE_SYSFS_RO(curr_obj_count_max);
 ZCACHE_SYSFS_RO(curr_objnode_count_max);
-ZCACHE_SYSFS_RO(flush_total);
-ZCACHE_SYSFS_RO(flush_found);
-ZCACHE_SYSFS_RO(flobj_total);
-ZCACHE_SYSFS_RO(flobj_found);
-ZCACHE_SYSFS_RO(failed_eph_puts);
-ZCACHE_SYSFS_RO(failed_pers_puts);
-ZCACHE_SYSFS_RO(zbud_curr_zbytes);
-ZCACHE_SYSFS_RO(zbud_cumul_zpages);
-ZCACHE_SYSFS_RO(zbud_cumul_zbytes);
+ZCACHE_SYSFS_RO_PERCPU(flush_total);
+ZCACHE_SYSFS_RO_PERCPU(flush_found);
+ZCACHE_SYSFS_RO_PERCPU(flobj_total);
+ZCACHE_SYSFS_RO_PERCPU(flobj_found);
+ZCACHE_SYSFS_RO_PERCPU(failed_eph_puts);
+ZCACHE_SYSFS_RO_PERCPU(failed_pers_puts);
+ZCACHE_SYSFS_RO_PERCPU(zbud_curr_zbytes);
+ZCACHE_SYSFS_RO_PERCPU(zbud_cumul_zpages);
+ZCACHE_SYSFS_RO_PERCPU(zbud_cumul_zbytes);
 ZCACHE_SYSFS_RO(zbud_buddied_count);
-ZCACHE_SYSFS_RO(zbpg_unused_list_count);
-ZCACHE_SYSFS_RO(evicted_raw_pages);
-ZCACHE_SYSFS_RO(evicted_unbuddied_pages);
-ZCACHE_SYSFS_RO(evicted_buddied_pages);
-ZCACHE_SYSFS_RO(failed_get_free_pages);
-ZCACHE_SYSFS_RO(failed_alloc);
-ZCACHE_SYSFS_RO(put_to_flush);
-ZCACHE_SYSFS_RO(aborted_preload);
-ZCACHE_SYSFS_RO(aborted_shrink);
-ZCACHE_SYSFS_RO(compress_poor);
+ZCACHE_SYSFS_RO_CUSTOM(zbpg_unused_list_count,
+			zbpg_show_unused_list_count);
+ZCACHE_SYSFS_RO_PERCPU(evicted_raw_pages);
+ZCACHE_SYSFS_RO_PERCPU(evicted_unbuddied_pages);
+ZCACHE_SYSFS_RO_PERCPU(evicted_buddied_pages);
+ZCACHE_SYSFS_RO_PERCPU(failed_get_free_pages);
+ZCACHE_SYSFS_RO_PERCPU(failed_alloc);
+ZCACHE_SYSFS_RO_PERCPU(put_to_flush);
+ZCACHE_SYSFS_RO_PERCPU(aborted_preload);
+ZCACHE_SYSFS_RO_PERCPU(aborted_shrink);
+ZCACHE_SYSFS_RO_PERCPU(compress_poor);
 ZCACHE_SYSFS_RO_ATOMIC(zbud_curr_raw_pages);
 ZCACHE_SYSFS_RO_ATOMIC(zbud_curr_zpages);
 ZCACHE_SYSFS_RO_ATOMIC(curr_obj_count);
@@ -1196,7 +1319,7 @@ static int shrink_zcache_memory(struct shrinker *shrink,
 			zbud_evict_pages(nr);
 			spin_unlock(&zcache_direct_reclaim_lock);
 		} else
-			zcache_aborted_shrink++;
+			zcache_stat_inc(aborted_shrink);
 	}
 	ret = (int)atomic_read(&zcache_zbud_curr_raw_pages);
 out:
@@ -1227,14 +1350,14 @@ static int zcache_put_page(int pool_id, struct tmem_oid *oidp,
 		ret = tmem_put(pool, oidp, index, page);
 		if (ret < 0) {
 			if (is_ephemeral(pool))
-				zcache_failed_eph_puts++;
+				zcache_stat_inc(failed_eph_puts);
 			else
-				zcache_failed_pers_puts++;
+				zcache_stat_inc(failed_pers_puts);
 		}
 		zcache_put_pool(pool);
 		preempt_enable_no_resched();
 	} else {
-		zcache_put_to_flush++;
+		zcache_stat_inc(put_to_flush);
 		if (atomic_read(&pool->obj_count) > 0)
 			/* the put fails whether the flush succeeds or not */
 			(void)tmem_flush_page(pool, oidp, index);
@@ -1269,7 +1392,7 @@ static int zcache_flush_page(int pool_id, struct tmem_oid *oidp, uint32_t index)
 	unsigned long flags;
 
 	local_irq_save(flags);
-	zcache_flush_total++;
+	zcache_stat_inc(flush_total);
 	pool = zcache_get_pool_by_id(pool_id);
 	if (likely(pool != NULL)) {
 		if (atomic_read(&pool->obj_count) > 0)
@@ -1277,7 +1400,7 @@ static int zcache_flush_page(int pool_id, struct tmem_oid *oidp, uint32_t index)
 		zcache_put_pool(pool);
 	}
 	if (ret >= 0)
-		zcache_flush_found++;
+		zcache_stat_inc(flush_found);
 	local_irq_restore(flags);
 	return ret;
 }
@@ -1289,7 +1412,7 @@ static int zcache_flush_object(int pool_id, struct tmem_oid *oidp)
 	unsigned long flags;
 
 	local_irq_save(flags);
-	zcache_flobj_total++;
+	zcache_stat_inc(flobj_total);
 	pool = zcache_get_pool_by_id(pool_id);
 	if (likely(pool != NULL)) {
 		if (atomic_read(&pool->obj_count) > 0)
@@ -1297,7 +1420,7 @@ static int zcache_flush_object(int pool_id, struct tmem_oid *oidp)
 		zcache_put_pool(pool);
 	}
 	if (ret >= 0)
-		zcache_flobj_found++;
+		zcache_stat_inc(flobj_found);
 	local_irq_restore(flags);
 	return ret;
 }
@@ -23,8 +23,17 @@
 #include <linux/poll.h>
 #include <linux/workqueue.h>
 
-/** Max number of pages that can be used in a single read request */
-#define FUSE_MAX_PAGES_PER_REQ 32
+/** Default max number of pages that can be used in a single request */
+#define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
+
+/** Upper limit for the max_pages a filesystem may negotiate at INIT */
+#define FUSE_MAX_MAX_PAGES 256
+
+/** Magic number of fuse and fuseblk superblocks */
+#define FUSE_SUPER_MAGIC 0x65735546
+
+/** Number of page pointers embedded in fuse_req */
+#define FUSE_REQ_INLINE_PAGES 1
 
 /** Bias for fi->writectr, meaning new writepages must not be sent */
 #define FUSE_NOWRITE INT_MIN
@@ -135,6 +144,12 @@ struct fuse_file {
 
 	/** Wait queue head for poll */
 	wait_queue_head_t poll_wait;
+
+	/** Lower file that reads, writes and mmap are passed to, or NULL */
+	struct file *passthrough_filp;
+
+	/** Daemon's credentials, used for I/O on passthrough_filp */
+	const struct cred *passthrough_cred;
 };
 
 /** One input argument of a request */
@@ -284,8 +299,20 @@ struct fuse_req {
 		struct fuse_lk_in lk_in;
 	} misc;
 
+	/** Lower file handed over in an OPEN or CREATE reply */
+	struct file *passthrough_filp;
+
+	/** Credentials of the daemon that handed it over */
+	const struct cred *passthrough_cred;
+
 	/** page vector */
-	struct page *pages[FUSE_MAX_PAGES_PER_REQ];
+	struct page **pages;
+
+	/** size of the 'pages' array */
+	unsigned max_pages;
+
+	/** inline page vector */
+	struct page *inline_pages[FUSE_REQ_INLINE_PAGES];
 
 	/** number of pages in vector */
 	unsigned num_pages;
@@ -309,6 +336,28 @@ struct fuse_req {
 	struct file *stolen_file;
 };
 
+/**
+ * A channel of a fuse connection.
+ *
+ * Every open /dev/fuse file attached to a connection is a channel: the
+ * one passed to mount and any cloned from it with FUSE_DEV_IOC_CLONE.
+ * Requests are queued on the channel of the submitting CPU, so that a
+ * daemon with a thread per channel keeps each request on one CPU.
+ */
+struct fuse_dev {
+	/** The connection this channel belongs to */
+	struct fuse_conn *fc;
+
+	/** Requests queued on this channel */
+	struct list_head pending;
+
+	/** Readers of the channel are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** Entry on fc->devices */
+	struct list_head entry;
+};
+
 /**
  * A Fuse connection.
  *
@@ -341,10 +390,16 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
-	wait_queue_head_t waitq;
+	/** Maximum number of pages that can be used in a single request */
+	unsigned max_pages;
+
+	/** The channels of the connection */
+	struct list_head devices;
 
-	/** The list of pending requests */
+	/** Channel of each CPU, once the connection has been cloned */
+	struct fuse_dev **chan_map;
+
+	/** Pending requests not routed to any particular channel */
 	struct list_head pending;
 
 	/** The list of requests being processed */
@@ -472,6 +527,9 @@ struct fuse_conn {
 	/** Don't apply umask to creation modes */
 	unsigned dont_mask:1;
 
+	/** May open replies name a lower file for passthrough? */
+	unsigned passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -640,11 +698,11 @@ int fuse_ctl_init(void);
 void fuse_ctl_cleanup(void);
 
 /**
- * Allocate a request
+ * Allocate a request with room for @npages pages
  */
-struct fuse_req *fuse_request_alloc(void);
+struct fuse_req *fuse_request_alloc(unsigned npages);
 
-struct fuse_req *fuse_request_alloc_nofs(void);
+struct fuse_req *fuse_request_alloc_nofs(unsigned npages);
 
 /**
  * Free a request
@@ -652,9 +710,14 @@ struct fuse_req *fuse_request_alloc_nofs(void);
 void fuse_request_free(struct fuse_req *req);
 
 /**
- * Get a request, may fail with -ENOMEM
+ * Get a request with room for @npages pages, may fail with -ENOMEM
  */
-struct fuse_req *fuse_get_req(struct fuse_conn *fc);
+struct fuse_req *fuse_get_req(struct fuse_conn *fc, unsigned npages);
+
+static inline struct fuse_req *fuse_get_req_nopages(struct fuse_conn *fc)
+{
+	return fuse_get_req(fc, 0);
+}
 
 /**
  * Gets a requests for a file operation, always succeeds
@@ -683,6 +746,19 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
 /* Abort all requests */
 void fuse_abort_conn(struct fuse_conn *fc);
 
+/**
+ * Attach a new channel to the connection
+ */
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
+
+/**
+ * Detach a channel and drop its reference to the connection
+ */
+void fuse_dev_free(struct fuse_dev *fud);
+
+/* Wake up all readers of the connection, called with fc->lock held */
+void fuse_dev_wake_all(struct fuse_conn *fc);
+
 /**
  * Invalidate inode attributes
  */
@@ -763,4 +839,14 @@ int fuse_dev_release(struct inode *inode, struct file *file);
 
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
+/* passthrough.c */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req);
+void fuse_passthrough_open(struct file *file, struct fuse_file *ff);
+void fuse_passthrough_release(struct fuse_file *ff);
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos);
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
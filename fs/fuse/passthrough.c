@@ -0,0 +1,181 @@
+/*
+  FUSE: Filesystem in Userspace
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Passthrough: when the daemon answers OPEN or CREATE with
+ * FOPEN_PASSTHROUGH, it names one of its own open files in
+ * passthrough_fd.  Reads, writes and mmap of the fuse file are then
+ * handed to that lower file directly, without a round trip through the
+ * daemon.  Everything else, attributes included, still goes through
+ * the daemon.
+ *
+ * The lower file is accessed with the daemon's credentials, captured
+ * when it handed the file over, as if the daemon did the I/O itself:
+ * permission and LSM checks on the lower file see the daemon, not the
+ * task using the fuse file.
+ */
+
+#include "fuse_i.h"
+
+#include <linux/cred.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+
+/*
+ * Called in the daemon's context while its reply to an OPEN or CREATE
+ * request is being written, which is the only place its descriptor
+ * table can be used to look up passthrough_fd.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_open_out *outarg;
+	struct file *lower;
+	unsigned idx;
+
+	if (!fc->passthrough || req->out.h.error)
+		return;
+	if (req->in.h.opcode != FUSE_OPEN && req->in.h.opcode != FUSE_CREATE)
+		return;
+
+	/* fuse_open_out is the last argument of both replies */
+	idx = req->out.numargs - 1;
+	if (req->out.args[idx].size != sizeof(*outarg))
+		return;
+	outarg = req->out.args[idx].value;
+	if (!(outarg->open_flags & FOPEN_PASSTHROUGH))
+		return;
+
+	lower = fget(outarg->passthrough_fd);
+	if (!lower)
+		return;
+
+	/*
+	 * Only a plain buffered file on another filesystem will do: a
+	 * fuse lower file could recurse, and O_DIRECT would let the
+	 * lower aio methods complete asynchronously.
+	 */
+	if (!S_ISREG(lower->f_dentry->d_inode->i_mode) ||
+	    lower->f_dentry->d_sb->s_magic == FUSE_SUPER_MAGIC ||
+	    (lower->f_flags & O_DIRECT) || !lower->f_op ||
+	    !lower->f_op->aio_read || !lower->f_op->aio_write ||
+	    !lower->f_op->mmap) {
+		fput(lower);
+		return;
+	}
+
+	req->passthrough_filp = lower;
+	req->passthrough_cred = get_current_cred();
+}
+
+/*
+ * Check the lower file against how the fuse file was opened, and fall
+ * back to going through the daemon if it could not honour it.
+ */
+void fuse_passthrough_open(struct file *file, struct fuse_file *ff)
+{
+	struct file *lower = ff->passthrough_filp;
+
+	if (!lower)
+		return;
+
+	if (((file->f_mode & FMODE_READ) && !(lower->f_mode & FMODE_READ)) ||
+	    ((file->f_mode & FMODE_WRITE) && !(lower->f_mode & FMODE_WRITE)) ||
+	    ((file->f_flags ^ lower->f_flags) & O_APPEND) ||
+	    (file->f_flags & ~lower->f_flags & (O_DSYNC | __O_SYNC)))
+		fuse_passthrough_release(ff);
+}
+
+void fuse_passthrough_release(struct fuse_file *ff)
+{
+	if (ff->passthrough_filp) {
+		fput(ff->passthrough_filp);
+		ff->passthrough_filp = NULL;
+	}
+	if (ff->passthrough_cred) {
+		put_cred(ff->passthrough_cred);
+		ff->passthrough_cred = NULL;
+	}
+}
+
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct file *lower = ff->passthrough_filp;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	old_cred = override_creds(ff->passthrough_cred);
+	iocb->ki_filp = lower;
+	ret = lower->f_op->aio_read(iocb, iov, nr_segs, pos);
+	iocb->ki_filp = file;
+	revert_creds(old_cred);
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct file *lower = ff->passthrough_filp;
+	struct inode *inode = file->f_mapping->host;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	old_cred = override_creds(ff->passthrough_cred);
+	iocb->ki_filp = lower;
+	ret = lower->f_op->aio_write(iocb, iov, nr_segs, pos);
+	iocb->ki_filp = file;
+	revert_creds(old_cred);
+
+	if (ret > 0) {
+		/* drop anything cached through a non-passthrough open */
+		if (inode->i_mapping->nrpages)
+			invalidate_inode_pages2_range(inode->i_mapping,
+				(iocb->ki_pos - ret) >> PAGE_CACHE_SHIFT,
+				(iocb->ki_pos - 1) >> PAGE_CACHE_SHIFT);
+		fuse_write_update_size(inode, iocb->ki_pos);
+	}
+	fuse_invalidate_attr(inode);
+
+	return ret;
+}
+
+/*
+ * Map the lower file instead: the vma takes a reference on it and
+ * drops the one mmap_region() took on the fuse file, so faults and
+ * writeback never involve the daemon.
+ */
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *lower = ff->passthrough_filp;
+	const struct cred *old_cred;
+	int ret;
+
+	if (WARN_ON(vma->vm_file != file))
+		return -EIO;
+
+	get_file(lower);
+	vma->vm_file = lower;
+	old_cred = override_creds(ff->passthrough_cred);
+	ret = lower->f_op->mmap(lower, vma);
+	revert_creds(old_cred);
+	if (ret) {
+		/* mmap_region() puts vm_file's original reference */
+		vma->vm_file = file;
+		fput(lower);
+	} else {
+		fput(file);
+	}
+	return ret;
+}
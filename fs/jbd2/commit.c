@@ -21,6 +21,7 @@
 #include <linux/mm.h>
 #include <linux/pagemap.h>
 #include <linux/jiffies.h>
+#include <linux/hrtimer.h>
 #include <linux/crc32.h>
 #include <linux/writeback.h>
 #include <linux/backing-dev.h>
@@ -302,6 +303,38 @@ static void write_tag_block(int tag_bytes, journal_block_tag_t *tag,
 		tag->t_blocknr_high = cpu_to_be32((block >> 31) >> 1);
 }
 
+/*
+ * Group commit for concurrent fsync callers.  If the last commit was
+ * asked for by more than one caller, fsyncs are arriving in parallel:
+ * hold a young transaction open until it is about as old as a commit
+ * takes on this device, so that the callers arriving meanwhile share
+ * this commit and its cache flush instead of each waiting for the next.
+ * A single process issuing a stream of fsyncs gains nothing from the
+ * wait, so it is skipped then, as jbd2_journal_stop() does for its
+ * synchronous handles.
+ */
+static void jbd2_batch_commit_requests(journal_t *journal,
+				       transaction_t *commit_transaction)
+{
+	u64 batch_time, trans_time;
+	ktime_t expires;
+
+	if (journal->j_last_commit_requests < 2)
+		return;
+	if (journal->j_flags & (JBD2_UNMOUNT | JBD2_ABORT))
+		return;
+
+	batch_time = jbd2_batch_time(journal);
+	trans_time = ktime_to_ns(ktime_sub(ktime_get(),
+					   commit_transaction->t_start_time));
+	if (trans_time >= batch_time)
+		return;
+
+	expires = ktime_add_ns(commit_transaction->t_start_time, batch_time);
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
+}
+
 /*
  * jbd2_journal_commit_transaction
  *
@@ -355,8 +388,11 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	jbd_debug(1, "JBD: starting commit of transaction %d\n",
 			commit_transaction->t_tid);
 
+	jbd2_batch_commit_requests(journal, commit_transaction);
+
 	write_lock(&journal->j_state_lock);
 	commit_transaction->t_state = T_LOCKED;
+	journal->j_last_commit_requests = commit_transaction->t_commit_requests;
 
 	trace_jbd2_commit_locking(journal, commit_transaction);
 	stats.run.rs_wait = commit_transaction->t_max_wait;
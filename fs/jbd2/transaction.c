@@ -1269,6 +1269,24 @@ drop:
 	return err;
 }
 
+/*
+ * How long a transaction should stay open to let further synchronous
+ * operations join it, in nanoseconds: the measured time a commit takes
+ * on this device, clamped to the journal's min and max batch times.
+ */
+u64 jbd2_batch_time(journal_t *journal)
+{
+	u64 commit_time;
+
+	read_lock(&journal->j_state_lock);
+	commit_time = journal->j_average_commit_time;
+	read_unlock(&journal->j_state_lock);
+
+	commit_time = max_t(u64, commit_time,
+			    1000*journal->j_min_batch_time);
+	return min_t(u64, commit_time, 1000*journal->j_max_batch_time);
+}
+
 /**
  * int jbd2_journal_stop() - complete a transaction
  * @handle: tranaction to complete.
@@ -1343,18 +1361,10 @@ int jbd2_journal_stop(handle_t *handle)
 
 		journal->j_last_sync_writer = pid;
 
-		read_lock(&journal->j_state_lock);
-		commit_time = journal->j_average_commit_time;
-		read_unlock(&journal->j_state_lock);
-
+		commit_time = jbd2_batch_time(journal);
 		trans_time = ktime_to_ns(ktime_sub(ktime_get(),
 						   transaction->t_start_time));
 
-		commit_time = max_t(u64, commit_time,
-				    1000*journal->j_min_batch_time);
-		commit_time = min_t(u64, commit_time,
-				    1000*journal->j_max_batch_time);
-
 		if (trans_time < commit_time) {
 			ktime_t expires = ktime_add_ns(ktime_get(),
 						       commit_time);
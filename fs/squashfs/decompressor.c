@@ -23,6 +23,7 @@
 
 #include <linux/types.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
 #include <linux/slab.h>
 #include <linux/buffer_head.h>
 
@@ -77,11 +78,27 @@ const struct squashfs_decompressor *squashfs_lookup_decompressor(int id)
 }
 
 
-void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
+/*
+ * Each CPU has a decompressor stream of its own, so that blocks missing
+ * from the caches can be decompressed by concurrent readers in parallel
+ * rather than one at a time.  A reader uses the stream of the CPU it
+ * starts on.  It may sleep waiting for buffers or be migrated while
+ * decompressing, so each stream is still protected by a mutex, which
+ * is only ever contended when that happens.
+ */
+struct squashfs_stream {
+	void		*stream;
+	struct mutex	mutex;
+};
+
+
+int squashfs_decompressor_setup(struct super_block *sb, unsigned short flags)
 {
 	struct squashfs_sb_info *msblk = sb->s_fs_info;
-	void *strm, *buffer = NULL;
-	int length = 0;
+	struct squashfs_stream __percpu *percpu;
+	struct squashfs_stream *stream;
+	void *buffer = NULL;
+	int err = 0, length = 0, cpu;
 
 	/*
 	 * Read decompressor specific options from file system if present
@@ -89,22 +106,76 @@ void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
 	if (SQUASHFS_COMP_OPTS(flags)) {
 		buffer = kmalloc(PAGE_CACHE_SIZE, GFP_KERNEL);
 		if (buffer == NULL)
-			return ERR_PTR(-ENOMEM);
+			return -ENOMEM;
 
 		length = squashfs_read_data(sb, &buffer,
 			sizeof(struct squashfs_super_block), 0, NULL,
 			PAGE_CACHE_SIZE, 1);
 
 		if (length < 0) {
-			strm = ERR_PTR(length);
+			err = length;
 			goto finished;
 		}
 	}
 
-	strm = msblk->decompressor->init(msblk, buffer, length);
+	percpu = alloc_percpu(struct squashfs_stream);
+	if (percpu == NULL) {
+		err = -ENOMEM;
+		goto finished;
+	}
+	msblk->stream = percpu;
+
+	for_each_possible_cpu(cpu) {
+		stream = per_cpu_ptr(percpu, cpu);
+		mutex_init(&stream->mutex);
+		stream->stream = msblk->decompressor->init(msblk, buffer,
+			length);
+		if (IS_ERR(stream->stream)) {
+			err = PTR_ERR(stream->stream);
+			stream->stream = NULL;
+			squashfs_decompressor_destroy(msblk);
+			break;
+		}
+	}
 
 finished:
 	kfree(buffer);
 
-	return strm;
+	return err;
+}
+
+
+void squashfs_decompressor_destroy(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_stream *stream;
+	int cpu;
+
+	if (msblk->stream == NULL)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		stream = per_cpu_ptr(msblk->stream, cpu);
+		if (stream->stream)
+			msblk->decompressor->free(stream->stream);
+	}
+	free_percpu(msblk->stream);
+	msblk->stream = NULL;
+}
+
+
+int squashfs_decompress(struct squashfs_sb_info *msblk, void **buffer,
+	struct buffer_head **bh, int b, int offset, int length, int srclength,
+	int pages)
+{
+	struct squashfs_stream *stream;
+	int res;
+
+	stream = per_cpu_ptr(msblk->stream, raw_smp_processor_id());
+
+	mutex_lock(&stream->mutex);
+	res = msblk->decompressor->decompress(msblk, stream->stream, buffer,
+		bh, b, offset, length, srclength, pages);
+	mutex_unlock(&stream->mutex);
+
+	return res;
 }
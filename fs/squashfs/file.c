@@ -371,6 +371,82 @@ static int read_blocklist(struct inode *inode, int index, u64 *block)
 }
 
 
+/*
+ * Decompress a datablock straight into the page cache pages covering it,
+ * rather than into the read_page cache and then copying it out page by
+ * page.  This is only done if none of those pages is in the page cache
+ * yet, and all of them are directly addressable, as the decompressors
+ * may sleep with the whole block mapped.
+ *
+ * Returns 0 if the block was read, -EAGAIN if it has to go through the
+ * read_page cache instead, or another negative error if reading failed.
+ * Page, which is locked, stays locked in all cases.
+ */
+static int squashfs_readpage_direct(struct page *page, u64 block, int bsize,
+	int start_index, int end_index)
+{
+	struct inode *inode = page->mapping->host;
+	int file_pages = (i_size_read(inode) + PAGE_CACHE_SIZE - 1) >>
+					PAGE_CACHE_SHIFT;
+	int pages, grabbed = 0, bytes, avail, i, res = -EAGAIN;
+	struct page **page_list;
+	void **pageaddr;
+
+	end_index = min(end_index, file_pages - 1);
+	pages = end_index - start_index + 1;
+
+	page_list = kmalloc(pages * sizeof(*page_list), GFP_KERNEL);
+	pageaddr = kmalloc(pages * sizeof(*pageaddr), GFP_KERNEL);
+	if (page_list == NULL || pageaddr == NULL)
+		goto out;
+
+	for (i = 0; i < pages; i++) {
+		struct page *push_page = start_index + i == page->index ? page :
+			grab_cache_page_nowait(page->mapping, start_index + i);
+
+		if (push_page == NULL)
+			goto release;
+
+		page_list[grabbed++] = push_page;
+		if (PageUptodate(push_page) || PageHighMem(push_page))
+			goto release;
+		pageaddr[i] = page_address(push_page);
+	}
+
+	/*
+	 * A block covering fewer pages than block_size (the last one)
+	 * can't decompress to more, and bounding srclength by them keeps an
+	 * uncompressed block from overrunning them.
+	 */
+	bytes = squashfs_read_data(inode->i_sb, pageaddr, block, bsize, NULL,
+		pages << PAGE_CACHE_SHIFT, pages);
+	if (bytes < 0) {
+		res = bytes;
+		goto release;
+	}
+
+	for (i = 0; i < pages; i++, bytes -= PAGE_CACHE_SIZE) {
+		avail = clamp_t(int, bytes, 0, PAGE_CACHE_SIZE);
+		memset(pageaddr[i] + avail, 0, PAGE_CACHE_SIZE - avail);
+		flush_dcache_page(page_list[i]);
+		SetPageUptodate(page_list[i]);
+	}
+	res = 0;
+
+release:
+	for (i = 0; i < grabbed; i++) {
+		if (page_list[i] == page)
+			continue;
+		unlock_page(page_list[i]);
+		page_cache_release(page_list[i]);
+	}
+out:
+	kfree(page_list);
+	kfree(pageaddr);
+	return res;
+}
+
+
 static int squashfs_readpage(struct file *file, struct page *page)
 {
 	struct inode *inode = page->mapping->host;
@@ -410,8 +486,20 @@ static int squashfs_readpage(struct file *file, struct page *page)
 			sparse = 1;
 		} else {
 			/*
-			 * Read and decompress datablock.
+			 * Read and decompress datablock, straight into the
+			 * page cache if possible.
 			 */
+			int res = squashfs_readpage_direct(page, block, bsize,
+						start_index, end_index);
+			if (res == 0) {
+				unlock_page(page);
+				return 0;
+			} else if (res != -EAGAIN) {
+				ERROR("Unable to read page, block %llx, size %x"
+					"\n", block, bsize);
+				goto error_out;
+			}
+
 			buffer = squashfs_get_datablock(inode->i_sb,
 								block, bsize);
 			if (buffer->error) {
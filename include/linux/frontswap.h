@@ -0,0 +1,111 @@
+#ifndef _LINUX_FRONTSWAP_H
+#define _LINUX_FRONTSWAP_H
+
+#include <linux/swap.h>
+#include <linux/mm.h>
+#include <linux/bitops.h>
+
+struct frontswap_ops {
+	void (*init)(unsigned);
+	int (*put_page)(unsigned, pgoff_t, struct page *);
+	int (*get_page)(unsigned, pgoff_t, struct page *);
+	void (*flush_page)(unsigned, pgoff_t);
+	void (*flush_area)(unsigned);
+};
+
+extern struct frontswap_ops
+	frontswap_register_ops(struct frontswap_ops *ops);
+extern unsigned long frontswap_curr_pages(void);
+extern void __frontswap_init(unsigned type);
+extern int __frontswap_put_page(struct page *page);
+extern int __frontswap_get_page(struct page *page);
+extern void __frontswap_flush_page(unsigned, pgoff_t);
+extern void __frontswap_flush_area(unsigned);
+extern int frontswap_enabled;
+
+#ifdef CONFIG_FRONTSWAP
+static inline bool frontswap_test(struct swap_info_struct *sis, pgoff_t offset)
+{
+	return sis->frontswap_map && test_bit(offset, sis->frontswap_map);
+}
+
+static inline void frontswap_set(struct swap_info_struct *sis, pgoff_t offset)
+{
+	if (sis->frontswap_map)
+		set_bit(offset, sis->frontswap_map);
+}
+
+static inline void frontswap_clear(struct swap_info_struct *sis,
+				   pgoff_t offset)
+{
+	if (sis->frontswap_map)
+		clear_bit(offset, sis->frontswap_map);
+}
+
+static inline void frontswap_map_set(struct swap_info_struct *sis,
+				     unsigned long *map)
+{
+	sis->frontswap_map = map;
+}
+
+static inline unsigned long *frontswap_map_get(struct swap_info_struct *sis)
+{
+	return sis->frontswap_map;
+}
+
+/*
+ * Swapon and swapoff always tell the frontend about a swap area, even
+ * before any backend has registered, so that a backend registered later
+ * can still be told about areas that are already in use.
+ */
+static inline void frontswap_init(unsigned type)
+{
+	__frontswap_init(type);
+}
+
+static inline void frontswap_flush_area(unsigned type)
+{
+	__frontswap_flush_area(type);
+}
+#else
+#define frontswap_enabled (0)
+#define frontswap_test(_sis, _offset) (0)
+#define frontswap_set(_sis, _offset) do { } while (0)
+#define frontswap_clear(_sis, _offset) do { } while (0)
+#define frontswap_map_set(_sis, _map) do { } while (0)
+#define frontswap_map_get(_sis) ((unsigned long *)NULL)
+#define frontswap_init(_type) do { } while (0)
+#define frontswap_flush_area(_type) do { } while (0)
+#endif
+
+/*
+ * As with cleancache, these shims reduce every frontswap hook to nothing
+ * if CONFIG_FRONTSWAP is disabled, and to a single global variable check
+ * if it is enabled but no frontswap backend has registered.
+ */
+
+static inline int frontswap_put_page(struct page *page)
+{
+	int ret = -1;
+
+	if (frontswap_enabled)
+		ret = __frontswap_put_page(page);
+	return ret;
+}
+
+static inline int frontswap_get_page(struct page *page)
+{
+	int ret = -1;
+
+	if (frontswap_enabled)
+		ret = __frontswap_get_page(page);
+	return ret;
+}
+
+static inline void frontswap_flush_page(unsigned type, pgoff_t offset)
+{
+	if (frontswap_enabled)
+		__frontswap_flush_page(type, offset);
+}
+
+#endif /* _LINUX_FRONTSWAP_H */
@@ -47,12 +47,21 @@
  *  - FUSE_IOCTL_UNRESTRICTED shall now return with array of 'struct
  *    fuse_ioctl_iovec' instead of ambiguous 'struct iovec'
  *  - add FUSE_IOCTL_32BIT flag
+ *
+ * Negotiated by INIT flag only, without a minor version bump:
+ *  - add FUSE_MAX_PAGES flag and max_pages field to fuse_init_out.
+ *    The flag bit and the fuse_init_out layout are those of 7.28, so
+ *    filesystems built against newer headers can use it as is.
+ *  - add FUSE_PASSTHROUGH flag, FOPEN_PASSTHROUGH open flag and
+ *    passthrough_fd in fuse_open_out
+ *  - add FUSE_DEV_IOC_CLONE ioctl on /dev/fuse
  */
 
 #ifndef _LINUX_FUSE_H
 #define _LINUX_FUSE_H
 
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /*
  * Version negotiation:
@@ -145,16 +154,21 @@ struct fuse_file_lock {
  * FOPEN_DIRECT_IO: bypass page cache for this open file
  * FOPEN_KEEP_CACHE: don't invalidate the data cache on open
  * FOPEN_NONSEEKABLE: the file is not seekable
+ * FOPEN_PASSTHROUGH: pass read, write and mmap to the file passthrough_fd
+ *		      refers to in the filesystem daemon
  */
 #define FOPEN_DIRECT_IO		(1 << 0)
 #define FOPEN_KEEP_CACHE	(1 << 1)
 #define FOPEN_NONSEEKABLE	(1 << 2)
+#define FOPEN_PASSTHROUGH	(1 << 7)
 
 /**
  * INIT request/reply flags
  *
  * FUSE_EXPORT_SUPPORT: filesystem handles lookups of "." and ".."
  * FUSE_DONT_MASK: don't apply umask to file mode on create operations
+ * FUSE_MAX_PAGES: init_out.max_pages contains the max number of req pages
+ * FUSE_PASSTHROUGH: FOPEN_PASSTHROUGH is supported
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -163,6 +177,8 @@ struct fuse_file_lock {
 #define FUSE_EXPORT_SUPPORT	(1 << 4)
 #define FUSE_BIG_WRITES		(1 << 5)
 #define FUSE_DONT_MASK		(1 << 6)
+#define FUSE_MAX_PAGES		(1 << 22)
+#define FUSE_PASSTHROUGH	(1 << 31)
 
 /**
  * CUSE INIT request/reply flags
@@ -282,6 +298,19 @@ enum fuse_notify_code {
 /* The read buffer is required to be at least 8k, but may be much larger */
 #define FUSE_MIN_READ_BUFFER 8192
 
+/*
+ * Clone a channel: issued on a freshly opened /dev/fuse with the
+ * descriptor of an already mounted one, it attaches the new file to the
+ * same connection.  Requests are then queued on the channel of the
+ * submitting CPU: with n channels, the k-th possible CPU is served by
+ * the (k % n)-th channel in order of creation, the mount descriptor
+ * being the first.  A daemon can bind the reader of channel k to those
+ * CPUs.  Idle readers still pick up requests of channels whose readers
+ * are all busy.
+ */
+#define FUSE_DEV_IOC_MAGIC		229
+#define FUSE_DEV_IOC_CLONE		_IOR(FUSE_DEV_IOC_MAGIC, 0, __u32)
+
 #define FUSE_COMPAT_ENTRY_OUT_SIZE 120
 
 struct fuse_entry_out {
@@ -380,7 +409,7 @@ struct fuse_create_in {
 struct fuse_open_out {
 	__u64	fh;
 	__u32	open_flags;
-	__u32	padding;
+	__s32	passthrough_fd;
 };
 
 struct fuse_release_in {
@@ -483,6 +512,10 @@ struct fuse_init_out {
 	__u16   max_background;
 	__u16   congestion_threshold;
 	__u32	max_write;
+	__u32	time_gran;	/* not used by this kernel */
+	__u16	max_pages;
+	__u16	padding;
+	__u32	unused[8];
 };
 
 #define CUSE_INIT_INFO_MAX 4096
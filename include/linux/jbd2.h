@@ -660,6 +660,13 @@ struct transaction_s
 	 */
 	unsigned int t_synchronous_commit:1;
 
+	/*
+	 * Number of times a commit of this transaction was requested while
+	 * it was running, i.e. roughly how many fsync callers share it.
+	 * [j_state_lock]
+	 */
+	unsigned int		t_commit_requests;
+
 	/* Disk flush needs to be sent to fs partition [no locking] */
 	int			t_need_data_flush;
 
@@ -759,6 +766,8 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_wbufsize: maximum number of buffer_heads allowed in j_wbuf, the
  *	number that will fit in j_blocksize
  * @j_last_sync_writer: most recent pid which did a synchronous write
+ * @j_last_commit_requests: number of commit requests folded into the last
+ *     commit, used to decide whether to hold the next one open for more
  * @j_history: Buffer storing the transactions statistics history
  * @j_history_max: Maximum number of transactions in the statistics history
  * @j_history_cur: Current number of transactions in the statistics history
@@ -969,6 +978,12 @@ struct journal_s
 	 */
 	pid_t			j_last_sync_writer;
 
+	/*
+	 * t_commit_requests of the transaction last committed.  [commit
+	 * thread only]
+	 */
+	unsigned int		j_last_commit_requests;
+
 	/*
 	 * the average amount of time in nanoseconds it takes to commit a
 	 * transaction to disk. [j_state_lock]
@@ -1224,6 +1239,7 @@ extern void	jbd2_journal_switch_revoke_table(journal_t *journal);
 
 int __jbd2_log_space_left(journal_t *); /* Called with journal locked */
 int jbd2_log_start_commit(journal_t *journal, tid_t tid);
+u64 jbd2_batch_time(journal_t *journal);
 int __jbd2_log_start_commit(journal_t *journal, tid_t tid);
 int jbd2_journal_start_commit(journal_t *journal, tid_t *tid);
 int jbd2_journal_force_commit_nested(journal_t *journal);
@@ -0,0 +1,11 @@
+#ifndef _LINUX_SWAPFILE_H
+#define _LINUX_SWAPFILE_H
+
+/*
+ * These were static in swapfile.c, but frontswap.c needs them and there
+ * is no reason to expose them to everything that includes swap.h.
+ */
+extern spinlock_t swap_lock;
+extern struct swap_info_struct *swap_info[];
+
+#endif /* _LINUX_SWAPFILE_H */
@@ -0,0 +1,36 @@
+/* include/linux/wakelock_dev.h
+ *
+ * Copyright (C) 2007-2008 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _LINUX_WAKELOCK_DEV_H
+#define _LINUX_WAKELOCK_DEV_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* Each open of /dev/wakelock (CONFIG_USER_WAKELOCK) gets its own suspend
+ * wake_lock, which is released when the file is closed. WAKELOCK_IOC_ACQUIRE
+ * takes a pointer to a __u64 timeout in nanoseconds, 0 meaning no timeout.
+ * WAKELOCK_IOC_SET_NAME names the lock for the statistics, it defaults to
+ * the name of the opening task.
+ */
+#define WAKELOCK_NAME_LEN	32
+
+#define __WAKELOCKIO	0xB5
+
+#define WAKELOCK_IOC_ACQUIRE	_IOW(__WAKELOCKIO, 1, __u64)
+#define WAKELOCK_IOC_RELEASE	_IO(__WAKELOCKIO, 2)
+#define WAKELOCK_IOC_SET_NAME	_IOW(__WAKELOCKIO, 3, char[WAKELOCK_NAME_LEN])
+
+#endif /* _LINUX_WAKELOCK_DEV_H */
@@ -312,6 +312,39 @@ TRACE_EVENT(mm_vmscan_lru_shrink_inactive,
 		show_reclaim_flags(__entry->reclaim_flags))
 );
 
+TRACE_EVENT(mm_vmscan_lru_isolate_hold,
+
+	TP_PROTO(int nid, int zid,
+			unsigned long nr_scanned, unsigned long nr_taken,
+			u64 hold_ns, int contended),
+
+	TP_ARGS(nid, zid, nr_scanned, nr_taken, hold_ns, contended),
+
+	TP_STRUCT__entry(
+		__field(int, nid)
+		__field(int, zid)
+		__field(unsigned long, nr_scanned)
+		__field(unsigned long, nr_taken)
+		__field(u64, hold_ns)
+		__field(int, contended)
+	),
+
+	TP_fast_assign(
+		__entry->nid = nid;
+		__entry->zid = zid;
+		__entry->nr_scanned = nr_scanned;
+		__entry->nr_taken = nr_taken;
+		__entry->hold_ns = hold_ns;
+		__entry->contended = contended;
+	),
+
+	TP_printk("nid=%d zid=%d nr_scanned=%ld nr_taken=%ld hold_ns=%llu contended=%d",
+		__entry->nid, __entry->zid,
+		__entry->nr_scanned, __entry->nr_taken,
+		(unsigned long long)__entry->hold_ns,
+		__entry->contended)
+);
+
 TRACE_EVENT(replace_swap_token,
 	TP_PROTO(struct mm_struct *old_mm,
 		 struct mm_struct *new_mm),
@@ -14,8 +14,13 @@
  */
 
 #include <linux/ctype.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
 #include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/uaccess.h>
 #include <linux/wakelock.h>
+#include <linux/wakelock_dev.h>
 #include <linux/slab.h>
 
 #include "power.h"
@@ -39,6 +44,23 @@ struct user_wake_lock {
 };
 struct rb_root user_wake_locks;
 
+/* A wake lock owned by an open file of /dev/wakelock */
+struct fd_wake_lock {
+	struct mutex		lock;	/* serializes ioctls on the file */
+	struct wake_lock	wake_lock;
+	char			name[WAKELOCK_NAME_LEN];
+};
+
+static u64 timeout_to_jiffies(u64 timeout)
+{
+	/* convert timeout from nanoseconds to jiffies > 0 */
+	timeout += (NSEC_PER_SEC / HZ) - 1;
+	do_div(timeout, (NSEC_PER_SEC / HZ));
+	if (timeout <= 0)
+		timeout = 1;
+	return timeout;
+}
+
 static struct user_wake_lock *lookup_wake_lock_name(
 	const char *buf, int allocate, long *timeoutptr)
 {
@@ -67,12 +89,7 @@ static struct user_wake_lock *lookup_wake_lock_name(
 			arg++;
 		if (*arg)
 			goto bad_arg;
-		/* convert timeout from nanoseconds to jiffies > 0 */
-		timeout += (NSEC_PER_SEC / HZ) - 1;
-		do_div(timeout, (NSEC_PER_SEC / HZ));
-		if (timeout <= 0)
-			timeout = 1;
-		*timeoutptr = timeout;
+		*timeoutptr = timeout_to_jiffies(timeout);
 	} else if (*arg)
 		goto bad_arg;
 	else if (timeoutptr)
@@ -217,3 +234,122 @@ not_found:
 	return n;
 }
 
+/*
+ * /dev/wakelock - a wake lock per open file
+ *
+ * The sysfs interface above has to parse and look up a name on every
+ * write. Here the lock is found through the file, and it is released
+ * when the file is closed, so a crashing client can not leak it.
+ */
+static int wakelock_dev_open(struct inode *inode, struct file *file)
+{
+	struct fd_wake_lock *l;
+
+	l = kzalloc(sizeof(*l), GFP_KERNEL);
+	if (l == NULL)
+		return -ENOMEM;
+
+	mutex_init(&l->lock);
+	get_task_comm(l->name, current);
+	wake_lock_init(&l->wake_lock, WAKE_LOCK_SUSPEND, l->name);
+	file->private_data = l;
+
+	if (debug_mask & DEBUG_NEW)
+		pr_info("wakelock_dev_open: new wake lock %s\n", l->name);
+	return 0;
+}
+
+static int wakelock_dev_release(struct inode *inode, struct file *file)
+{
+	struct fd_wake_lock *l = file->private_data;
+
+	if (debug_mask & DEBUG_ACCESS)
+		pr_info("wakelock_dev_release: %s\n", l->name);
+
+	/* wake_unlock() would kick off a suspend attempt even if we held
+	 * nothing */
+	if (wake_lock_active(&l->wake_lock))
+		wake_unlock(&l->wake_lock);
+	wake_lock_destroy(&l->wake_lock);
+	kfree(l);
+	return 0;
+}
+
+static long wakelock_dev_ioctl(struct file *file, unsigned int cmd,
+			       unsigned long arg)
+{
+	struct fd_wake_lock *l = file->private_data;
+	void __user *argp = (void __user *)arg;
+	char name[WAKELOCK_NAME_LEN];
+	u64 timeout;
+	long ret = 0;
+
+	mutex_lock(&l->lock);
+	switch (cmd) {
+	case WAKELOCK_IOC_ACQUIRE:
+		if (copy_from_user(&timeout, argp, sizeof(timeout))) {
+			ret = -EFAULT;
+			break;
+		}
+		if (debug_mask & DEBUG_ACCESS)
+			pr_info("wakelock_dev_ioctl: acquire %s, timeout %llu\n",
+				l->name, timeout);
+		if (timeout)
+			wake_lock_timeout(&l->wake_lock,
+					  timeout_to_jiffies(timeout));
+		else
+			wake_lock(&l->wake_lock);
+		break;
+	case WAKELOCK_IOC_RELEASE:
+		if (debug_mask & DEBUG_ACCESS)
+			pr_info("wakelock_dev_ioctl: release %s\n", l->name);
+		wake_unlock(&l->wake_lock);
+		break;
+	case WAKELOCK_IOC_SET_NAME:
+		/* the statistics refer to the name, only rename idle locks */
+		if (wake_lock_active(&l->wake_lock)) {
+			ret = -EBUSY;
+			break;
+		}
+		if (copy_from_user(name, argp, sizeof(name))) {
+			ret = -EFAULT;
+			break;
+		}
+		name[sizeof(name) - 1] = '\0';
+		wake_lock_destroy(&l->wake_lock);
+		strcpy(l->name, name);
+		wake_lock_init(&l->wake_lock, WAKE_LOCK_SUSPEND, l->name);
+		break;
+	default:
+		ret = -ENOTTY;
+		break;
+	}
+	mutex_unlock(&l->lock);
+
+	return ret;
+}
+
+static const struct file_operations wakelock_dev_fops = {
+	.owner = THIS_MODULE,
+	.open = wakelock_dev_open,
+	.release = wakelock_dev_release,
+	.unlocked_ioctl = wakelock_dev_ioctl,
+	.compat_ioctl = wakelock_dev_ioctl,
+};
+
+static struct miscdevice wakelock_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "wakelock",
+	.fops = &wakelock_dev_fops,
+};
+
+static int __init userwakelock_init(void)
+{
+	int ret;
+
+	ret = misc_register(&wakelock_dev);
+	if (ret)
+		pr_err("userwakelock_init: misc_register failed\n");
+	return ret;
+}
+device_initcall(userwakelock_init);
@@ -189,6 +189,15 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Whether ksmd should scale its batches by how much they merge */
+static unsigned int ksm_thread_adaptive;
+
+/* Pages ksmd currently scans in one batch, when adaptive */
+static unsigned int ksm_adaptive_pages_to_scan;
+
+/* The number of times a page has been merged into a ksm page */
+static unsigned long ksm_pages_merged;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -1105,6 +1114,23 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 
 		cond_resched();
 		tree_rmap_item = rb_entry(*new, struct rmap_item, node);
+
+		/*
+		 * The unstable tree is ordered by checksum first, and only
+		 * pages with the same checksum need to be looked up and
+		 * compared.  A node's checksum can't change while it is in
+		 * the tree, so this ordering is at least as stable as the
+		 * contents ordering below it.
+		 */
+		if (rmap_item->oldchecksum != tree_rmap_item->oldchecksum) {
+			parent = *new;
+			if (rmap_item->oldchecksum < tree_rmap_item->oldchecksum)
+				new = &parent->rb_left;
+			else
+				new = &parent->rb_right;
+			continue;
+		}
+
 		tree_page = get_mergeable_page(tree_rmap_item);
 		if (IS_ERR_OR_NULL(tree_page))
 			return NULL;
@@ -1153,9 +1179,10 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 	rmap_item->address |= STABLE_FLAG;
 	hlist_add_head(&rmap_item->hlist, &stable_node->hlist);
 
-	if (rmap_item->hlist.next)
+	if (rmap_item->hlist.next) {
 		ksm_pages_sharing++;
-	else
+		ksm_pages_merged++;
+	} else
 		ksm_pages_shared++;
 }
 
@@ -1428,15 +1455,57 @@ static int ksmd_should_run(void)
 	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
 }
 
+/*
+ * When adaptive, ksmd keeps scanning pages_to_scan pages per batch only
+ * while that pays off: a batch merging at least one page in
+ * KSM_ADAPTIVE_YIELD doubles the next one, back up to pages_to_scan,
+ * while a batch merging nothing shrinks the next by an eighth, down to
+ * pages_to_scan >> KSM_ADAPTIVE_MIN_SHIFT.
+ */
+#define KSM_ADAPTIVE_YIELD	32
+#define KSM_ADAPTIVE_MIN_SHIFT	4
+
+static unsigned int ksm_scan_npages(void)
+{
+	unsigned int max_npages = ksm_thread_pages_to_scan;
+	unsigned int min_npages = max_npages >> KSM_ADAPTIVE_MIN_SHIFT;
+
+	if (!ksm_thread_adaptive || !max_npages)
+		return max_npages;
+	ksm_adaptive_pages_to_scan = clamp(ksm_adaptive_pages_to_scan,
+					   max(min_npages, 1U), max_npages);
+	return ksm_adaptive_pages_to_scan;
+}
+
+static void ksm_adapt_scan_rate(unsigned int scanned, unsigned long merged)
+{
+	unsigned int npages = ksm_adaptive_pages_to_scan;
+
+	if (merged * KSM_ADAPTIVE_YIELD >= scanned)
+		npages = min(npages, UINT_MAX / 2) * 2;
+	else if (!merged)
+		npages -= npages / 8;
+	ksm_adaptive_pages_to_scan = npages;
+}
+
 static int ksm_scan_thread(void *nothing)
 {
+	unsigned long merged;
+	unsigned int npages;
+
 	set_freezable();
 	set_user_nice(current, 5);
 
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
+		if (ksmd_should_run()) {
+			npages = ksm_scan_npages();
+			merged = ksm_pages_merged;
+			ksm_do_scan(npages);
+			if (ksm_thread_adaptive)
+				ksm_adapt_scan_rate(npages,
+						    ksm_pages_merged - merged);
+		}
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
@@ -1872,6 +1941,44 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t adaptive_scan_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_thread_adaptive);
+}
+
+static ssize_t adaptive_scan_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	int err;
+	unsigned long adaptive;
+
+	err = strict_strtoul(buf, 10, &adaptive);
+	if (err || adaptive > 1)
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	if (adaptive && !ksm_thread_adaptive)
+		ksm_adaptive_pages_to_scan = ksm_thread_pages_to_scan;
+	ksm_thread_adaptive = adaptive;
+	mutex_unlock(&ksm_thread_mutex);
+
+	return count;
+}
+KSM_ATTR(adaptive_scan);
+
+static ssize_t cur_pages_to_scan_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	unsigned int npages = ksm_thread_pages_to_scan;
+
+	if (ksm_thread_adaptive)
+		npages = min(ksm_adaptive_pages_to_scan, npages);
+	return sprintf(buf, "%u\n", npages);
+}
+KSM_ATTR_RO(cur_pages_to_scan);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -1966,15 +2073,25 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_merged_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_merged);
+}
+KSM_ATTR_RO(pages_merged);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
+	&adaptive_scan_attr.attr,
+	&cur_pages_to_scan_attr.attr,
 	&run_attr.attr,
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&pages_merged_attr.attr,
 	NULL,
 };
 
@@ -2000,12 +2000,17 @@ EXPORT_SYMBOL(mem_cgroup_update_page_stat);
 
 /*
  * size of first charge trial. "32" comes from vmscan.c's magic value.
- * TODO: maybe necessary to use big numbers in big irons.
+ * The per-cpu batch doubles every time the stock is refilled for the same
+ * memcg, up to CHARGE_BATCH_MAX, so a task faulting in a lot of memory
+ * goes to the res_counters less and less often.  A batch that runs into
+ * the limit starts over from CHARGE_BATCH.
  */
 #define CHARGE_BATCH	32U
+#define CHARGE_BATCH_MAX	(4 * CHARGE_BATCH)
 struct memcg_stock_pcp {
 	struct mem_cgroup *cached; /* this never be root cgroup */
 	unsigned int nr_pages;
+	unsigned int batch;	/* next charge batch for cached */
 	struct work_struct work;
 	unsigned long flags;
 #define FLUSHING_CACHED_CHARGE	(0)
@@ -2073,11 +2078,51 @@ static void refill_stock(struct mem_cgroup *mem, unsigned int nr_pages)
 	if (stock->cached != mem) { /* reset if necessary */
 		drain_stock(stock);
 		stock->cached = mem;
+		stock->batch = CHARGE_BATCH;
 	}
 	stock->nr_pages += nr_pages;
+	stock->batch = min(stock->batch * 2, CHARGE_BATCH_MAX);
 	put_cpu_var(memcg_stock);
 }
 
+/*
+ * Returns how many pages to charge ahead of time for "mem" on this cpu.
+ */
+static unsigned int stock_batch(struct mem_cgroup *mem)
+{
+	struct memcg_stock_pcp *stock = &get_cpu_var(memcg_stock);
+	unsigned int batch = CHARGE_BATCH;
+
+	if (stock->cached == mem)
+		batch = stock->batch;
+	put_cpu_var(memcg_stock);
+	return batch;
+}
+
+/*
+ * Hand charges being freed in a batch back to the local stock instead of
+ * the res_counter, if the stock is free or already caches "mem".  Returns
+ * the number of pages taken.
+ */
+static unsigned long uncharge_to_stock(struct mem_cgroup *mem,
+				       unsigned long nr_pages)
+{
+	struct memcg_stock_pcp *stock = &get_cpu_var(memcg_stock);
+	unsigned long taken = 0;
+
+	if (!stock->cached) {
+		stock->cached = mem;
+		stock->batch = CHARGE_BATCH;
+	}
+	if (stock->cached == mem && stock->nr_pages < CHARGE_BATCH_MAX) {
+		taken = min_t(unsigned long, nr_pages,
+			      CHARGE_BATCH_MAX - stock->nr_pages);
+		stock->nr_pages += taken;
+	}
+	put_cpu_var(memcg_stock);
+	return taken;
+}
+
 /*
  * Tries to drain stocked charges in other cpus. This function is asynchronous
  * and just put a work per cpu for draining localy on each cpu. Caller can
@@ -2206,7 +2251,8 @@ enum {
 };
 
 static int mem_cgroup_do_charge(struct mem_cgroup *mem, gfp_t gfp_mask,
-				unsigned int nr_pages, bool oom_check)
+				unsigned int nr_pages, unsigned int min_pages,
+				bool oom_check)
 {
 	unsigned long csize = nr_pages * PAGE_SIZE;
 	struct mem_cgroup *mem_over_limit;
@@ -2230,12 +2276,13 @@ static int mem_cgroup_do_charge(struct mem_cgroup *mem, gfp_t gfp_mask,
 		mem_over_limit = mem_cgroup_from_res_counter(fail_res, res);
 	/*
 	 * nr_pages can be either a huge page (HPAGE_PMD_NR), a batch
-	 * of regular pages (CHARGE_BATCH), or a single regular page (1).
+	 * of regular pages (see stock_batch()), or a single regular
+	 * page (1).  min_pages is what the caller actually needs.
 	 *
-	 * Never reclaim on behalf of optional batching, retry with a
-	 * single page instead.
+	 * Never reclaim on behalf of optional batching, retry with
+	 * min_pages instead.
 	 */
-	if (nr_pages == CHARGE_BATCH)
+	if (nr_pages > min_pages)
 		return CHARGE_RETRY;
 
 	if (!(gfp_mask & __GFP_WAIT))
@@ -2284,7 +2331,7 @@ static int __mem_cgroup_try_charge(struct mm_struct *mm,
 				   struct mem_cgroup **memcg,
 				   bool oom)
 {
-	unsigned int batch = max(CHARGE_BATCH, nr_pages);
+	unsigned int batch = 0;
 	int nr_oom_retries = MEM_CGROUP_RECLAIM_RETRIES;
 	struct mem_cgroup *mem = NULL;
 	int ret;
@@ -2355,6 +2402,9 @@ again:
 		rcu_read_unlock();
 	}
 
+	if (!batch)
+		batch = max(stock_batch(mem), nr_pages);
+
 	do {
 		bool oom_check;
 
@@ -2370,11 +2420,15 @@ again:
 			nr_oom_retries = MEM_CGROUP_RECLAIM_RETRIES;
 		}
 
-		ret = mem_cgroup_do_charge(mem, gfp_mask, batch, oom_check);
+		ret = mem_cgroup_do_charge(mem, gfp_mask, batch, nr_pages,
+					   oom_check);
 		switch (ret) {
 		case CHARGE_OK:
 			break;
 		case CHARGE_RETRY: /* not in OOM situation but retry */
+			/* close to the limit: stop charging ahead so much */
+			if (batch > nr_pages)
+				this_cpu_write(memcg_stock.batch, CHARGE_BATCH);
 			batch = nr_pages;
 			css_put(&mem->css);
 			mem = NULL;
@@ -3129,7 +3183,23 @@ void mem_cgroup_uncharge_end(void)
 	/*
 	 * This "batch->memcg" is valid without any css_get/put etc...
 	 * bacause we hide charges behind us.
+	 *
+	 * Pages charged to both res and memsw can go to the local stock,
+	 * where the next faults on this cpu find them without touching
+	 * the res_counters.
 	 */
+	if (batch->nr_pages &&
+	    (!do_swap_account || batch->memsw_nr_pages)) {
+		unsigned long nr_pages = batch->nr_pages;
+		unsigned long taken;
+
+		if (do_swap_account)
+			nr_pages = min(nr_pages, batch->memsw_nr_pages);
+		taken = uncharge_to_stock(batch->memcg, nr_pages);
+		batch->nr_pages -= taken;
+		if (do_swap_account)
+			batch->memsw_nr_pages -= taken;
+	}
 	if (batch->nr_pages)
 		res_counter_uncharge(&batch->memcg->res,
 				     batch->nr_pages * PAGE_SIZE);
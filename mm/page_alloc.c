@@ -651,6 +651,47 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 	spin_unlock(&zone->lock);
 }
 
+/*
+ * Frees at least count pages from the pcp's high-order lists back to
+ * the buddy allocator, largest order first and oldest blocks first.
+ * Stops early if the lists run dry.  Returns the number of pages freed.
+ */
+static int free_pcppages_bulk_orders(struct zone *zone, int count,
+					struct per_cpu_pages *pcp)
+{
+	int order, migratetype;
+	int freed = 0;
+
+	spin_lock(&zone->lock);
+	zone->all_unreclaimable = 0;
+	zone->pages_scanned = 0;
+
+	for (order = PCP_MAX_ORDER; order > 0 && freed < count; order--) {
+		for (migratetype = 0; migratetype < MIGRATE_PCPTYPES &&
+					freed < count; migratetype++) {
+			struct list_head *list;
+
+			list = &pcp->order_lists[order - 1][migratetype];
+			while (!list_empty(list) && freed < count) {
+				struct page *page;
+
+				page = list_entry(list->prev, struct page, lru);
+				list_del(&page->lru);
+				__free_one_page(page, zone, order,
+						page_private(page));
+				trace_mm_page_pcpu_drain(page, order,
+						page_private(page));
+				freed += 1 << order;
+			}
+		}
+	}
+	pcp->order_count -= freed;
+	__mod_zone_page_state(zone, NR_FREE_PAGES, freed);
+	spin_unlock(&zone->lock);
+
+	return freed;
+}
+
 static void free_one_page(struct zone *zone, struct page *page, int order,
 				int migratetype)
 {
@@ -691,18 +732,46 @@ static bool free_pages_prepare(struct page *page, unsigned int order)
 
 static void __free_pages_ok(struct page *page, unsigned int order)
 {
+	struct zone *zone = page_zone(page);
+	struct per_cpu_pages *pcp;
 	unsigned long flags;
+	int migratetype;
 	int wasMlocked = __TestClearPageMlocked(page);
 
 	if (!free_pages_prepare(page, order))
 		return;
 
+	migratetype = get_pageblock_migratetype(page);
 	local_irq_save(flags);
 	if (unlikely(wasMlocked))
 		free_page_mlock(page);
 	__count_vm_events(PGFREE, 1 << order);
-	free_one_page(page_zone(page), page, order,
-					get_pageblock_migratetype(page));
+
+	/*
+	 * Small high-order blocks go to the pcp lists like order-0 pages
+	 * do in free_hot_cold_page(), with the same treatment of ISOLATE
+	 * and RESERVE pageblocks.
+	 */
+	if (order > PCP_MAX_ORDER || migratetype == MIGRATE_ISOLATE) {
+		free_one_page(zone, page, order, migratetype);
+		goto out;
+	}
+	if (migratetype >= MIGRATE_PCPTYPES)
+		migratetype = MIGRATE_MOVABLE;
+
+	/* the block may be handed out again without the compound flags */
+	if (unlikely(PageCompound(page)) &&
+	    unlikely(destroy_compound_page(page, order)))
+		goto out;
+
+	set_page_private(page, migratetype);
+	pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	list_add(&page->lru, &pcp->order_lists[order - 1][migratetype]);
+	pcp->order_count += 1 << order;
+	if (pcp->order_count > pcp->order_high)
+		free_pcppages_bulk_orders(zone, pcp->order_batch, pcp);
+
+out:
 	local_irq_restore(flags);
 }
 
@@ -1088,6 +1157,8 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 		to_drain = pcp->count;
 	free_pcppages_bulk(zone, to_drain, pcp);
 	pcp->count -= to_drain;
+	if (pcp->order_count)
+		free_pcppages_bulk_orders(zone, pcp->order_batch, pcp);
 	local_irq_restore(flags);
 }
 #endif
@@ -1116,6 +1187,8 @@ static void drain_pages(unsigned int cpu)
 			free_pcppages_bulk(zone, pcp->count, pcp);
 			pcp->count = 0;
 		}
+		if (pcp->order_count)
+			free_pcppages_bulk_orders(zone, pcp->order_count, pcp);
 		local_irq_restore(flags);
 	}
 }
@@ -1311,6 +1384,20 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 	struct page *page;
 	int cold = !!(gfp_flags & __GFP_COLD);
 
+	if (unlikely(gfp_flags & __GFP_NOFAIL)) {
+		/*
+		 * __GFP_NOFAIL is not to be used in new code.
+		 *
+		 * All __GFP_NOFAIL callers should be fixed so that they
+		 * properly detect and handle allocation failures.
+		 *
+		 * We most definitely don't want callers attempting to
+		 * allocate greater than order-1 page units with
+		 * __GFP_NOFAIL.
+		 */
+		WARN_ON_ONCE(order > 1);
+	}
+
 again:
 	if (likely(order == 0)) {
 		struct per_cpu_pages *pcp;
@@ -1334,20 +1421,25 @@ again:
 
 		list_del(&page->lru);
 		pcp->count--;
-	} else {
-		if (unlikely(gfp_flags & __GFP_NOFAIL)) {
-			/*
-			 * __GFP_NOFAIL is not to be used in new code.
-			 *
-			 * All __GFP_NOFAIL callers should be fixed so that they
-			 * properly detect and handle allocation failures.
-			 *
-			 * We most definitely don't want callers attempting to
-			 * allocate greater than order-1 page units with
-			 * __GFP_NOFAIL.
-			 */
-			WARN_ON_ONCE(order > 1);
+	} else if (order <= PCP_MAX_ORDER) {
+		struct per_cpu_pages *pcp;
+		struct list_head *list;
+
+		local_irq_save(flags);
+		pcp = &this_cpu_ptr(zone->pageset)->pcp;
+		list = &pcp->order_lists[order - 1][migratetype];
+		if (list_empty(list)) {
+			pcp->order_count += rmqueue_bulk(zone, order,
+					max(pcp->order_batch >> order, 1),
+					list, migratetype, 0) << order;
+			if (unlikely(list_empty(list)))
+				goto failed;
 		}
+
+		page = list_entry(list->next, struct page, lru);
+		list_del(&page->lru);
+		pcp->order_count -= 1 << order;
+	} else {
 		spin_lock_irqsave(&zone->lock, flags);
 		page = __rmqueue(zone, order, migratetype);
 		spin_unlock(&zone->lock);
@@ -2591,9 +2683,12 @@ void show_free_areas(unsigned int filter)
 
 			pageset = per_cpu_ptr(zone->pageset, cpu);
 
-			printk("CPU %4d: hi:%5d, btch:%4d usd:%4d\n",
+			printk("CPU %4d: hi:%5d, btch:%4d usd:%4d "
+			       "ord_hi:%5d ord_usd:%4d\n",
 			       cpu, pageset->pcp.high,
-			       pageset->pcp.batch, pageset->pcp.count);
+			       pageset->pcp.batch, pageset->pcp.count,
+			       pageset->pcp.order_high,
+			       pageset->pcp.order_count);
 		}
 	}
 
@@ -3603,7 +3698,7 @@ static int zone_batchsize(struct zone *zone)
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 {
 	struct per_cpu_pages *pcp;
-	int migratetype;
+	int migratetype, order;
 
 	memset(p, 0, sizeof(*p));
 
@@ -3613,6 +3708,14 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 	pcp->batch = max(1UL, 1 * batch);
 	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
 		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+
+	pcp->order_count = 0;
+	pcp->order_high = pcp->high / 2;
+	pcp->order_batch = pcp->batch;
+	for (order = 0; order < PCP_MAX_ORDER; order++)
+		for (migratetype = 0; migratetype < MIGRATE_PCPTYPES;
+							migratetype++)
+			INIT_LIST_HEAD(&pcp->order_lists[order][migratetype]);
 }
 
 /*
@@ -3630,6 +3733,9 @@ static void setup_pagelist_highmark(struct per_cpu_pageset *p,
 	pcp->batch = max(1UL, high/4);
 	if ((high/4) > (PAGE_SHIFT * 8))
 		pcp->batch = PAGE_SHIFT * 8;
+
+	pcp->order_high = pcp->high / 2;
+	pcp->order_batch = pcp->batch;
 }
 
 static void setup_zone_pageset(struct zone *zone)
@@ -3720,6 +3826,7 @@ static int __zone_pcp_update(void *data)
 
 		local_irq_save(flags);
 		free_pcppages_bulk(zone, pcp->count, pcp);
+		free_pcppages_bulk_orders(zone, pcp->order_count, pcp);
 		setup_pageset(pset, batch);
 		local_irq_restore(flags);
 	}
@@ -4325,6 +4432,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 	pgdat->nr_zones = 0;
 	init_waitqueue_head(&pgdat->kswapd_wait);
 	pgdat->kswapd_max_order = 0;
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat_page_cgroup_init(pgdat);
 	
 	for (j = 0; j < MAX_NR_ZONES; j++) {
@@ -17,6 +17,8 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
 
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
@@ -486,6 +488,183 @@ readit:
 	return ra_submit(ra, mapping, filp);
 }
 
+/*
+ * Readahead replay.  Starting an application does many short, scattered
+ * reads of its libraries and packages, too random for the heuristics above
+ * but much the same from one start to the next.  So the first few misses on
+ * each open file are recorded against its inode, as a short sorted list of
+ * page ranges, and the first miss on a later open of that inode reads the
+ * whole list ahead at once, in file order.  Records live in memory only;
+ * they are keyed by device and inode number so they outlive the inode, are
+ * dropped when the file is modified, and recycled least recently used.
+ */
+#define RA_REPLAY_MISSES	64	/* misses recorded per open file */
+#define RA_REPLAY_RANGES	32	/* page ranges kept per inode */
+#define RA_REPLAY_RECORDS	256	/* inodes remembered */
+#define RA_REPLAY_HASH_BITS	6
+
+struct ra_replay_range {
+	pgoff_t start;
+	unsigned long nr;
+};
+
+struct ra_replay {
+	struct hlist_node hash;
+	struct list_head lru;
+	dev_t dev;
+	unsigned long ino;
+	struct timespec mtime;
+	unsigned int nr_ranges;
+	struct ra_replay_range ranges[RA_REPLAY_RANGES];
+};
+
+int sysctl_readahead_replay __read_mostly;
+
+static DEFINE_SPINLOCK(ra_replay_lock);
+static struct hlist_head ra_replay_hash[1 << RA_REPLAY_HASH_BITS];
+static LIST_HEAD(ra_replay_lru);
+static unsigned int ra_replay_nr;
+
+static struct hlist_head *ra_replay_bucket(dev_t dev, unsigned long ino)
+{
+	return &ra_replay_hash[hash_long(ino ^ dev, RA_REPLAY_HASH_BITS)];
+}
+
+/* Find the inode's record, forgetting what it held if the file changed */
+static struct ra_replay *ra_replay_lookup(struct inode *inode)
+{
+	struct ra_replay *rec;
+	struct hlist_node *node;
+	dev_t dev = inode->i_sb->s_dev;
+
+	hlist_for_each_entry(rec, node, ra_replay_bucket(dev, inode->i_ino),
+			     hash) {
+		if (rec->dev != dev || rec->ino != inode->i_ino)
+			continue;
+		if (!timespec_equal(&rec->mtime, &inode->i_mtime)) {
+			rec->mtime = inode->i_mtime;
+			rec->nr_ranges = 0;
+		}
+		list_move(&rec->lru, &ra_replay_lru);
+		return rec;
+	}
+	return NULL;
+}
+
+/*
+ * Add [start, start + nr) to the record, merging it with every range it
+ * overlaps or abuts.  If it touches none and the record is full, it is
+ * left out: the ranges recorded first are the ones a start waits on.
+ */
+static void ra_replay_add(struct ra_replay *rec, pgoff_t start,
+			  unsigned long nr)
+{
+	struct ra_replay_range *r = rec->ranges;
+	pgoff_t end = start + nr;
+	unsigned int i, j;
+
+	for (i = 0; i < rec->nr_ranges; i++)
+		if (r[i].start + r[i].nr >= start)
+			break;
+	for (j = i; j < rec->nr_ranges && r[j].start <= end; j++) {
+		start = min(start, r[j].start);
+		end = max(end, r[j].start + r[j].nr);
+	}
+
+	if (j == i) {
+		if (rec->nr_ranges == RA_REPLAY_RANGES)
+			return;
+		memmove(&r[i + 1], &r[i], (rec->nr_ranges - i) * sizeof(*r));
+		rec->nr_ranges++;
+	} else if (j > i + 1) {
+		memmove(&r[i + 1], &r[j], (rec->nr_ranges - j) * sizeof(*r));
+		rec->nr_ranges -= j - i - 1;
+	}
+	r[i].start = start;
+	r[i].nr = end - start;
+}
+
+static void ra_replay_record(struct inode *inode, pgoff_t offset,
+			     unsigned long nr)
+{
+	struct ra_replay *rec, *new = NULL;
+
+retry:
+	spin_lock(&ra_replay_lock);
+	rec = ra_replay_lookup(inode);
+	if (!rec) {
+		if (ra_replay_nr >= RA_REPLAY_RECORDS) {
+			rec = list_entry(ra_replay_lru.prev,
+					 struct ra_replay, lru);
+			hlist_del(&rec->hash);
+			list_del(&rec->lru);
+		} else if (new) {
+			rec = new;
+			new = NULL;
+			ra_replay_nr++;
+		} else {
+			spin_unlock(&ra_replay_lock);
+			new = kmalloc(sizeof(*new), GFP_NOFS | __GFP_NOWARN);
+			if (!new)
+				return;
+			goto retry;
+		}
+		rec->dev = inode->i_sb->s_dev;
+		rec->ino = inode->i_ino;
+		rec->mtime = inode->i_mtime;
+		rec->nr_ranges = 0;
+		hlist_add_head(&rec->hash, ra_replay_bucket(rec->dev, rec->ino));
+		list_add(&rec->lru, &ra_replay_lru);
+	}
+	ra_replay_add(rec, offset, nr);
+	spin_unlock(&ra_replay_lock);
+	kfree(new);
+}
+
+static void ra_replay(struct address_space *mapping, struct file *filp)
+{
+	struct ra_replay_range ranges[RA_REPLAY_RANGES];
+	struct ra_replay *rec;
+	unsigned int i, nr_ranges = 0;
+
+	spin_lock(&ra_replay_lock);
+	rec = ra_replay_lookup(mapping->host);
+	if (rec) {
+		nr_ranges = rec->nr_ranges;
+		memcpy(ranges, rec->ranges, nr_ranges * sizeof(ranges[0]));
+	}
+	spin_unlock(&ra_replay_lock);
+
+	for (i = 0; i < nr_ranges; i++)
+		force_page_cache_readahead(mapping, filp, ranges[i].start,
+					   ranges[i].nr);
+}
+
+/**
+ * page_cache_replay_readahead - record a miss, replaying earlier ones first
+ * @mapping: address_space which holds the pagecache and I/O vectors
+ * @ra: file_ra_state which holds the readahead state
+ * @filp: the file being read
+ * @offset: start offset into @mapping, in pagecache page-sized units
+ * @req_size: number of pages the caller is about to read
+ *
+ * Called on a page cache miss, before any other readahead is done for it.
+ * Does nothing unless vm.readahead_replay is set.
+ */
+void page_cache_replay_readahead(struct address_space *mapping,
+				 struct file_ra_state *ra, struct file *filp,
+				 pgoff_t offset, unsigned long req_size)
+{
+	if (!sysctl_readahead_replay || !filp)
+		return;
+	if (ra->replay_miss >= RA_REPLAY_MISSES)
+		return;
+
+	if (ra->replay_miss++ == 0)
+		ra_replay(mapping, filp);
+	ra_replay_record(mapping->host, offset, req_size);
+}
+
 /**
  * page_cache_sync_readahead - generic file readahead
  * @mapping: address_space which holds the pagecache and I/O vectors
@@ -508,6 +687,8 @@ void page_cache_sync_readahead(struct address_space *mapping,
 	if (!ra->ra_pages)
 		return;
 
+	page_cache_replay_readahead(mapping, ra, filp, offset, req_size);
+
 	/* be dumb */
 	if (filp && (filp->f_mode & FMODE_RANDOM)) {
 		force_page_cache_readahead(mapping, filp, offset, req_size);
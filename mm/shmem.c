@@ -1536,6 +1536,53 @@ out:
 	return error;
 }
 
+/*
+ * Pages in the naturally aligned clusters of a mapping that
+ * shmem_fault_cluster() fills in one go: the fault-around window of
+ * mm/memory.c, so that a whole cluster is mapped by one fault.
+ */
+#define SHMEM_FAULT_CLUSTER	16UL
+
+/*
+ * A large shared region, a graphics buffer in ashmem say, touched from
+ * start to end would take a fault and a trip through shmem_getpage for
+ * every page.  When a fault lands on the first page of a cluster and the
+ * page before it is already there, allocate the rest of the cluster up
+ * front: fault-around then maps all of it on the way out of this fault.
+ * Random faults into a sparse file allocate nothing extra.
+ */
+static void shmem_fault_cluster(struct inode *inode,
+				struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	unsigned long address = (unsigned long)vmf->virtual_address;
+	pgoff_t index = vmf->pgoff;
+	struct page *page;
+	pgoff_t end;
+
+	if (!(vma->vm_flags & VM_SHARED) || (vma->vm_flags & VM_NONLINEAR))
+		return;
+	if ((address >> PAGE_SHIFT) & (SHMEM_FAULT_CLUSTER - 1))
+		return;
+	/* don't start swapin behind the faulting page's back */
+	if (SHMEM_I(inode)->swapped)
+		return;
+	if (address != vma->vm_start) {
+		page = find_get_page(inode->i_mapping, index - 1);
+		if (!page)
+			return;
+		page_cache_release(page);
+	}
+
+	end = min3(index + SHMEM_FAULT_CLUSTER, vma->vm_pgoff + vma_pages(vma),
+		   (pgoff_t)DIV_ROUND_UP(i_size_read(inode), PAGE_CACHE_SIZE));
+	for (index++; index < end; index++) {
+		if (shmem_getpage(inode, index, &page, SGP_CACHE, NULL))
+			break;
+		unlock_page(page);
+		page_cache_release(page);
+	}
+}
+
 static int shmem_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 {
 	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
@@ -1545,6 +1592,8 @@ static int shmem_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	if (((loff_t)vmf->pgoff << PAGE_CACHE_SHIFT) >= i_size_read(inode))
 		return VM_FAULT_SIGBUS;
 
+	shmem_fault_cluster(inode, vma, vmf);
+
 	error = shmem_getpage(inode, vmf->pgoff, &vmf->page, SGP_CACHE, &ret);
 	if (error)
 		return ((error == -ENOMEM) ? VM_FAULT_OOM : VM_FAULT_SIGBUS);
@@ -2773,6 +2822,7 @@ static const struct super_operations shmem_ops = {
 
 static const struct vm_operations_struct shmem_vm_ops = {
 	.fault		= shmem_fault,
+	.map_pages	= filemap_map_pages,
 #ifdef CONFIG_NUMA
 	.set_policy     = shmem_set_policy,
 	.get_policy     = shmem_get_policy,
@@ -217,6 +217,8 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	int i;
 
 	cleancache_flush_inode(mapping);
+	if (mapping->nrshadows)
+		workingset_forget(mapping, start, lend >> PAGE_CACHE_SHIFT);
 	if (mapping->nrpages == 0)
 		return;
 
@@ -404,7 +406,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	BUG_ON(page_has_private(page));
-	__delete_from_page_cache(page);
+	__delete_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
@@ -481,7 +481,8 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
  * Same as remove_mapping, but if the page is removed from the mapping, it
  * gets returned with a refcount of 0.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -527,10 +528,21 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
+		void *shadow = NULL;
 
 		freepage = mapping->a_ops->freepage;
 
-		__delete_from_page_cache(page);
+		/*
+		 * Remember when reclaim evicted the page so a refault can
+		 * tell thrashing from cold cache, see mm/workingset.c.
+		 * Invalidation carries no such information.  Shadows are
+		 * only kept in an inode's own i_data, which is where the
+		 * inode teardown looks for them.
+		 */
+		if (reclaimed && page_is_file_cache(page) && mapping->host &&
+		    mapping == &mapping->host->i_data)
+			shadow = workingset_eviction(mapping, page);
+		__delete_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 
@@ -553,7 +565,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -901,7 +913,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
 		/*
@@ -1394,6 +1406,28 @@ static inline bool should_reclaim_stall(unsigned long nr_taken,
 	return priority <= lumpy_stall_priority;
 }
 
+/*
+ * shrink_inactive_list() isolates pages in chunks of LRU_ISOLATE_CHUNK and
+ * checks for contention on zone->lru_lock between them, so a large batch
+ * does not hold the lock any longer than a single chunk would when others
+ * are waiting for it.
+ */
+#define LRU_ISOLATE_CHUNK	SWAP_CLUSTER_MAX
+
+/*
+ * The largest batch shrink_zone() hands to shrink_inactive_list().  Callers
+ * with a reclaim target above SWAP_CLUSTER_MAX, kswapd in particular, scan
+ * this many pages per call so the lru_add_drain(), isolation and putback
+ * round trips on zone->lru_lock are paid once for more pages.
+ */
+#define LRU_ISOLATE_BATCH	(4 * SWAP_CLUSTER_MAX)
+
+static unsigned long inactive_scan_batch(struct scan_control *sc)
+{
+	return clamp_t(unsigned long, sc->nr_to_reclaim,
+		       SWAP_CLUSTER_MAX, LRU_ISOLATE_BATCH);
+}
+
 /*
  * shrink_inactive_list() is a helper for shrink_zone().  It returns the number
  * of reclaimed pages
@@ -1403,11 +1437,16 @@ shrink_inactive_list(unsigned long nr_to_scan, struct zone *zone,
 			struct scan_control *sc, int priority, int file)
 {
 	LIST_HEAD(page_list);
-	unsigned long nr_scanned;
+	unsigned long nr_scanned = 0;
 	unsigned long nr_reclaimed = 0;
-	unsigned long nr_taken;
-	unsigned long nr_anon;
-	unsigned long nr_file;
+	unsigned long nr_taken = 0;
+	unsigned long nr_anon = 0;
+	unsigned long nr_file = 0;
+	unsigned long hold_scanned = 0;
+	unsigned long hold_taken = 0;
+	int contended = 0;
+	int mode;
+	u64 start;
 
 	while (unlikely(too_many_isolated(zone, file, sc))) {
 		congestion_wait(BLK_RW_ASYNC, HZ/10);
@@ -1418,44 +1457,87 @@ shrink_inactive_list(unsigned long nr_to_scan, struct zone *zone,
 	}
 
 	set_reclaim_mode(priority, sc, false);
+	mode = sc->reclaim_mode & RECLAIM_MODE_LUMPYRECLAIM ?
+					ISOLATE_BOTH : ISOLATE_INACTIVE;
 	lru_add_drain();
 	spin_lock_irq(&zone->lru_lock);
+	start = local_clock();
+
+	while (nr_scanned < nr_to_scan) {
+		LIST_HEAD(chunk);
+		unsigned long nr = min(nr_to_scan - nr_scanned,
+				       (unsigned long)LRU_ISOLATE_CHUNK);
+		unsigned long chunk_scanned, chunk_taken;
+		unsigned long chunk_anon, chunk_file;
+
+		if (scanning_global_lru(sc)) {
+			chunk_taken = isolate_pages_global(nr, &chunk,
+				&chunk_scanned, sc->order, mode, zone, 0, file);
+			zone->pages_scanned += chunk_scanned;
+			if (current_is_kswapd())
+				__count_zone_vm_events(PGSCAN_KSWAPD, zone,
+						       chunk_scanned);
+			else
+				__count_zone_vm_events(PGSCAN_DIRECT, zone,
+						       chunk_scanned);
+		} else {
+			chunk_taken = mem_cgroup_isolate_pages(nr,
+				&chunk, &chunk_scanned, sc->order, mode,
+				zone, sc->mem_cgroup, 0, file);
+			/*
+			 * mem_cgroup_isolate_pages() keeps track of
+			 * scanned pages on its own.
+			 */
+		}
+		nr_scanned += chunk_scanned;
+		hold_scanned += chunk_scanned;
+
+		if (chunk_taken) {
+			update_isolated_counts(zone, sc, &chunk_anon,
+					       &chunk_file, &chunk);
+			nr_anon += chunk_anon;
+			nr_file += chunk_file;
+			nr_taken += chunk_taken;
+			hold_taken += chunk_taken;
+			list_splice(&chunk, &page_list);
+		}
+
+		/* Done, or the list ran dry */
+		if (nr_scanned >= nr_to_scan || chunk_scanned < nr)
+			break;
+
+		if (!spin_is_contended(&zone->lru_lock) && !need_resched())
+			continue;
 
-	if (scanning_global_lru(sc)) {
-		nr_taken = isolate_pages_global(nr_to_scan,
-			&page_list, &nr_scanned, sc->order,
-			sc->reclaim_mode & RECLAIM_MODE_LUMPYRECLAIM ?
-					ISOLATE_BOTH : ISOLATE_INACTIVE,
-			zone, 0, file);
-		zone->pages_scanned += nr_scanned;
-		if (current_is_kswapd())
-			__count_zone_vm_events(PGSCAN_KSWAPD, zone,
-					       nr_scanned);
-		else
-			__count_zone_vm_events(PGSCAN_DIRECT, zone,
-					       nr_scanned);
-	} else {
-		nr_taken = mem_cgroup_isolate_pages(nr_to_scan,
-			&page_list, &nr_scanned, sc->order,
-			sc->reclaim_mode & RECLAIM_MODE_LUMPYRECLAIM ?
-					ISOLATE_BOTH : ISOLATE_INACTIVE,
-			zone, sc->mem_cgroup,
-			0, file);
 		/*
-		 * mem_cgroup_isolate_pages() keeps track of
-		 * scanned pages on its own.
+		 * Someone else wants the lock.  A direct reclaimer that
+		 * already has pages backs off and reclaims those; kswapd
+		 * and empty-handed reclaimers let the waiters in and
+		 * carry on.
 		 */
-	}
+		contended = 1;
+		if (nr_taken && !current_is_kswapd())
+			break;
 
-	if (nr_taken == 0) {
+		trace_mm_vmscan_lru_isolate_hold(zone->zone_pgdat->node_id,
+			zone_idx(zone), hold_scanned, hold_taken,
+			local_clock() - start, contended);
 		spin_unlock_irq(&zone->lru_lock);
-		return 0;
+		cond_resched();
+		spin_lock_irq(&zone->lru_lock);
+		start = local_clock();
+		hold_scanned = hold_taken = 0;
+		contended = 0;
 	}
 
-	update_isolated_counts(zone, sc, &nr_anon, &nr_file, &page_list);
-
+	trace_mm_vmscan_lru_isolate_hold(zone->zone_pgdat->node_id,
+		zone_idx(zone), hold_scanned, hold_taken,
+		local_clock() - start, contended);
 	spin_unlock_irq(&zone->lru_lock);
 
+	if (nr_taken == 0)
+		return 0;
+
 	nr_reclaimed = shrink_page_list(&page_list, zone, sc);
 
 	/* Check if we should syncronously wait for writeback */
@@ -1949,8 +2031,10 @@ restart:
 					nr[LRU_INACTIVE_FILE]) {
 		for_each_evictable_lru(l) {
 			if (nr[l]) {
-				nr_to_scan = min_t(unsigned long,
-						   nr[l], SWAP_CLUSTER_MAX);
+				nr_to_scan = min_t(unsigned long, nr[l],
+						   is_active_lru(l) ?
+						   SWAP_CLUSTER_MAX :
+						   inactive_scan_batch(sc));
 				nr[l] -= nr_to_scan;
 
 				nr_reclaimed += shrink_list(l, nr_to_scan,
@@ -2695,6 +2779,15 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
 		 * them before going back to sleep.
 		 */
 		set_pgdat_percpu_threshold(pgdat, calculate_normal_threshold);
+
+		/*
+		 * The node is balanced, so whatever high-order pages are
+		 * missing now are missing through fragmentation: hand them
+		 * over to kcompactd rather than leave them to the next
+		 * high-order allocation to compact directly.
+		 */
+		wakeup_kcompactd(pgdat, order, classzone_idx);
+
 		schedule();
 		set_pgdat_percpu_threshold(pgdat, calculate_pressure_threshold);
 	} else {
@@ -0,0 +1,292 @@
+/*
+ * Workingset detection
+ *
+ * The file LRU cannot tell a page that was evicted while it was still
+ * being used from one that went cold: both leave the inactive list and
+ * are gone.  When the working set is bigger than the inactive list but
+ * would fit alongside the active list, it is read back in over and over
+ * while cold pages sit on the active list.
+ *
+ * Every zone keeps a clock, inactive_age, that ticks on each eviction
+ * and each activation from its file LRU, since both move pages out of
+ * the inactive list.  When reclaim evicts a file page, the clock value
+ * is left behind in the mapping's shadow_tree at the page's index.
+ *
+ * If the page is faulted back in, the difference between the clock now
+ * and the shadow is its refault distance: how many slots the inactive
+ * list would have needed on top of its actual size to keep the page.
+ * Nothing else can give those slots but the active list, so a page
+ * whose refault distance is no larger than the active file list is
+ * activated right away and has to compete with the active pages, rather
+ * than get thrown out of the inactive list again.
+ *
+ * Shadow entries are removed when the page comes back, when the file is
+ * truncated and when the inode goes away.  Shadows of long-lived inodes
+ * would otherwise stay forever, so a shrinker also drops them under
+ * memory pressure, from the mappings that have held shadows longest.
+ * Their number is further capped at a quarter of RAM's pages as a
+ * backstop; beyond that evictions leave no shadow behind.
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/swap.h>
+#include <linux/pagemap.h>
+#include <linux/pagevec.h>
+#include <linux/percpu_counter.h>
+#include <linux/radix-tree.h>
+#include <linux/module.h>
+
+/*
+ * A shadow entry packs the eviction clock, node and zone into a long.
+ * Bit 1 is always set: this keeps the entry non-NULL, and keeps bit 0
+ * clear, which a direct entry at the radix tree root needs.
+ */
+#define SHADOW_ENTRY_TAG	2
+#define SHADOW_ENTRY_SHIFT	2
+#define EVICTION_SHIFT	(SHADOW_ENTRY_SHIFT + NODES_SHIFT + ZONES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static struct percpu_counter nr_shadows;
+static unsigned long max_shadows;	/* 0 until workingset_init() */
+
+/*
+ * Mappings holding shadow entries, oldest first, for the shrinker.  A
+ * mapping is linked when it gets its first shadow and unlinked when it
+ * loses its last one, both under its tree_lock, which this lock nests
+ * inside.  The shrinker takes it first and only trylocks tree_lock.
+ */
+static LIST_HEAD(shadow_mappings);
+static DEFINE_SPINLOCK(shadow_mappings_lock);
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << SHADOW_ENTRY_SHIFT) | SHADOW_ENTRY_TAG;
+
+	return (void *)eviction;
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction, refault;
+	int zid, nid;
+
+	entry >>= SHADOW_ENTRY_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+	refault = atomic_long_read(&(*zone)->inactive_age);
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a file page
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping's shadow_tree at the
+ * page's index, or NULL if there is no room for more shadows.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	if (percpu_counter_read(&nr_shadows) >= (s64)max_shadows)
+		return NULL;
+
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Returns true if the page should be activated right away.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+/*
+ * Store @shadow for the page just removed at @index.  The caller holds
+ * mapping->tree_lock.
+ */
+void workingset_store_shadow(struct address_space *mapping, pgoff_t index,
+			     void *shadow)
+{
+	if (radix_tree_insert(&mapping->shadow_tree, index, shadow))
+		return;
+	if (!mapping->nrshadows++) {
+		spin_lock(&shadow_mappings_lock);
+		list_add_tail(&mapping->shadow_list, &shadow_mappings);
+		spin_unlock(&shadow_mappings_lock);
+	}
+	percpu_counter_inc(&nr_shadows);
+}
+
+/* The caller holds mapping->tree_lock; shadow_mappings_lock is not held */
+static void shadow_mapping_unlink(struct address_space *mapping)
+{
+	spin_lock(&shadow_mappings_lock);
+	list_del_init(&mapping->shadow_list);
+	spin_unlock(&shadow_mappings_lock);
+}
+
+/*
+ * Remove and return the shadow at @index, if any, as a page is inserted
+ * there.  The caller holds mapping->tree_lock.
+ */
+void *workingset_take_shadow(struct address_space *mapping, pgoff_t index)
+{
+	void *shadow;
+
+	shadow = radix_tree_delete(&mapping->shadow_tree, index);
+	if (shadow) {
+		if (!--mapping->nrshadows)
+			shadow_mapping_unlink(mapping);
+		percpu_counter_dec(&nr_shadows);
+	}
+	return shadow;
+}
+
+/*
+ * Delete up to PAGEVEC_SIZE shadows of @mapping between @start and @end,
+ * and return how many went.  *@next is set to the index after the last
+ * one.  The caller holds mapping->tree_lock.
+ */
+static unsigned int drop_shadows(struct address_space *mapping, pgoff_t start,
+				 pgoff_t end, pgoff_t *next)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned int i, nr;
+
+	nr = radix_tree_gang_lookup_slot(&mapping->shadow_tree, slots,
+					 indices, start, PAGEVEC_SIZE);
+	for (i = 0; i < nr && indices[i] <= end; i++)
+		radix_tree_delete(&mapping->shadow_tree, indices[i]);
+	if (!i)
+		return 0;
+
+	*next = indices[i - 1] + 1;
+	mapping->nrshadows -= i;
+	percpu_counter_sub(&nr_shadows, i);
+	return i;
+}
+
+/**
+ * workingset_forget - drop shadow entries of a range of a mapping
+ * @mapping: the address space
+ * @start: first index to drop
+ * @end: last index to drop, inclusive
+ *
+ * Called on truncation and inode teardown.  May sleep.
+ */
+void workingset_forget(struct address_space *mapping, pgoff_t start,
+		       pgoff_t end)
+{
+	pgoff_t index = start;
+
+	while (index <= end) {
+		unsigned int nr;
+
+		spin_lock_irq(&mapping->tree_lock);
+		nr = drop_shadows(mapping, index, end, &index);
+		if (nr && !mapping->nrshadows)
+			shadow_mapping_unlink(mapping);
+		spin_unlock_irq(&mapping->tree_lock);
+
+		/* short batch: the tree or the range is exhausted */
+		if (nr < PAGEVEC_SIZE || !index)
+			break;
+		cond_resched();
+	}
+}
+
+/*
+ * Drop shadows a batch at a time from the mapping at the head of the
+ * list, which then goes to the tail.  Inodes that are being torn down
+ * cannot go away under us: they unlink themselves under
+ * shadow_mappings_lock before they are freed.
+ */
+static int shadow_shrink(struct shrinker *shrink, struct shrink_control *sc)
+{
+	unsigned long nr_to_scan = sc->nr_to_scan;
+	struct address_space *mapping;
+	unsigned int nr;
+	pgoff_t next;
+
+	while (nr_to_scan) {
+		spin_lock_irq(&shadow_mappings_lock);
+		if (list_empty(&shadow_mappings)) {
+			spin_unlock_irq(&shadow_mappings_lock);
+			break;
+		}
+		mapping = list_first_entry(&shadow_mappings,
+					   struct address_space, shadow_list);
+		list_move_tail(&mapping->shadow_list, &shadow_mappings);
+
+		nr = 0;
+		if (spin_trylock(&mapping->tree_lock)) {
+			nr = drop_shadows(mapping, 0, ULONG_MAX, &next);
+			if (!mapping->nrshadows)
+				list_del_init(&mapping->shadow_list);
+			spin_unlock(&mapping->tree_lock);
+		}
+		spin_unlock_irq(&shadow_mappings_lock);
+
+		/* a busy mapping counts as one, so that we always progress */
+		nr_to_scan -= min_t(unsigned long, nr_to_scan, max(nr, 1U));
+		cond_resched();
+	}
+
+	return min_t(s64, percpu_counter_read_positive(&nr_shadows), INT_MAX);
+}
+
+static struct shrinker shadow_shrinker = {
+	.shrink = shadow_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init workingset_init(void)
+{
+	int err;
+
+	err = percpu_counter_init(&nr_shadows, 0);
+	if (err)
+		return err;
+	max_shadows = totalram_pages / 4;
+	register_shrinker(&shadow_shrinker);
+	return 0;
+}
+module_init(workingset_init);